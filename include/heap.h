@@ -0,0 +1,153 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_MIN_HEAP_H
+#define _LINUX_MIN_HEAP_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "list_head.h"
+
+/*
+ * Intrusive binary min-heap. Embed a struct heap_node in the entries, and
+ * the heap keeps pointers to the nodes ordered by @less so that the first
+ * one is the least. Each node remembers its slot, so that any of them can
+ * be taken out or fixed up in O(log n).
+ */
+struct heap_node {
+	unsigned int index;		/* Slot in @nodes of the heap */
+};
+
+struct min_heap {
+	struct heap_node **nodes;
+	unsigned int nr;
+	unsigned int size;
+	bool (*less)(const struct heap_node *, const struct heap_node *);
+};
+
+#define heap_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define heap_entry_safe(ptr, type, member) \
+	({ __typeof__(ptr) ____ptr = (ptr); \
+	   ____ptr ? heap_entry(____ptr, type, member) : NULL; \
+	})
+
+static inline void min_heap_init(struct min_heap *heap,
+				 bool (*less)(const struct heap_node *, const struct heap_node *))
+{
+	heap->nodes = NULL;
+	heap->nr = heap->size = 0;
+	heap->less = less;
+}
+
+static inline void min_heap_free(struct min_heap *heap)
+{
+	free(heap->nodes);
+	heap->nodes = NULL;
+	heap->nr = heap->size = 0;
+}
+
+static inline bool min_heap_empty(const struct min_heap *heap)
+{
+	return !heap->nr;
+}
+
+static inline struct heap_node *min_heap_peek(const struct min_heap *heap)
+{
+	return heap->nr ? heap->nodes[0] : NULL;
+}
+
+/* Whether @node is in @heap rather than in another one */
+static inline bool min_heap_contains(const struct min_heap *heap, const struct heap_node *node)
+{
+	return node->index < heap->nr && heap->nodes[node->index] == node;
+}
+
+static inline void __min_heap_set(struct min_heap *heap, unsigned int index,
+				  struct heap_node *node)
+{
+	heap->nodes[index] = node;
+	node->index = index;
+}
+
+static inline void __min_heap_sift_up(struct min_heap *heap, unsigned int index)
+{
+	struct heap_node *node = heap->nodes[index];
+
+	while (index) {
+		unsigned int parent = (index - 1) / 2;
+
+		if (!heap->less(node, heap->nodes[parent]))
+			break;
+		__min_heap_set(heap, index, heap->nodes[parent]);
+		index = parent;
+	}
+	__min_heap_set(heap, index, node);
+}
+
+static inline void __min_heap_sift_down(struct min_heap *heap, unsigned int index)
+{
+	struct heap_node *node = heap->nodes[index];
+
+	while (true) {
+		unsigned int child = index * 2 + 1;
+
+		if (child >= heap->nr)
+			break;
+		if (child + 1 < heap->nr && heap->less(heap->nodes[child + 1], heap->nodes[child]))
+			child++;
+		if (!heap->less(heap->nodes[child], node))
+			break;
+		__min_heap_set(heap, index, heap->nodes[child]);
+		index = child;
+	}
+	__min_heap_set(heap, index, node);
+}
+
+/* Returns false when running out of memory to grow the heap */
+static inline bool min_heap_push(struct min_heap *heap, struct heap_node *node)
+{
+	if (heap->nr == heap->size) {
+		unsigned int size = heap->size ? heap->size * 2 : 64;
+		struct heap_node **nodes = realloc(heap->nodes, sizeof(*nodes) * size);
+
+		if (!nodes)
+			return false;
+		heap->nodes = nodes;
+		heap->size = size;
+	}
+
+	__min_heap_set(heap, heap->nr++, node);
+	__min_heap_sift_up(heap, node->index);
+	return true;
+}
+
+static inline void min_heap_remove(struct min_heap *heap, struct heap_node *node)
+{
+	unsigned int index = node->index;
+	struct heap_node *last = heap->nodes[--heap->nr];
+
+	if (last == node)
+		return;
+
+	__min_heap_set(heap, index, last);
+	__min_heap_sift_up(heap, index);
+	__min_heap_sift_down(heap, last->index);
+}
+
+static inline struct heap_node *min_heap_pop(struct min_heap *heap)
+{
+	struct heap_node *node = min_heap_peek(heap);
+
+	if (node)
+		min_heap_remove(heap, node);
+	return node;
+}
+
+/* Restore the order after the key of @node has changed */
+static inline void min_heap_fix(struct min_heap *heap, struct heap_node *node)
+{
+	__min_heap_sift_up(heap, node->index);
+	__min_heap_sift_down(heap, node->index);
+}
+
+#endif
@@ -16,8 +16,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "parser.h"
 
@@ -38,16 +43,104 @@ static void __print_prompt(void)
 	fprintf(stderr, "%s%s%s ", __color_start, cwd, __color_end);
 }
 
+/***********************************************************************
+ * Script given with -f. It is mapped (or slurped if it cannot be mapped)
+ * as a whole and split into lines in the shell, so there is no stdio buffer
+ * or file offset a child could inherit and consume as ghost inputs.
+ */
+static char *__script = NULL;
+static size_t __script_len = 0;
+static size_t __script_pos = 0;
+static bool __script_mapped = false;
+
+static int __slurp_script(int fd)
+{
+	size_t size = 1 << 16;
+	ssize_t len;
+
+	while (true) {
+		char *buf;
+
+		if (__script_len == size || !__script) {
+			buf = realloc(__script, size *= 2);
+			if (!buf) return -ENOMEM;
+			__script = buf;
+		}
+
+		len = read(fd, __script + __script_len, size - __script_len);
+		if (len < 0 && errno == EINTR) continue;
+		if (len < 0) return -errno;
+		if (len == 0) return 0;
+		__script_len += len;
+	}
+}
+
+static int __open_script(const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	int ret = 0;
+
+	if (fd < 0) return -errno;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			__script = map;
+			__script_len = st.st_size;
+			__script_mapped = true;
+		}
+	}
+
+	if (!__script_mapped) ret = __slurp_script(fd);
+
+	close(fd);
+	return ret;
+}
+
+static void __close_script(void)
+{
+	if (__script_mapped) {
+		munmap(__script, __script_len);
+	} else {
+		free(__script);
+	}
+}
+
+/* Copy the next line of the script to @command like fgets() does */
+static char *__read_script(char *command, size_t size)
+{
+	const char *start = __script + __script_pos;
+	size_t len = __script_len - __script_pos;
+	const char *eol;
+
+	if (!len) return NULL;
+
+	if (len > size - 1) len = size - 1;
+	eol = memchr(start, '\n', len);
+	if (eol) len = eol - start + 1;
+
+	memcpy(command, start, len);
+	command[len] = '\0';
+	__script_pos += len;
+
+	return command;
+}
+
 /***********************************************************************
  * main() of this program.
  */
 int main(int argc, char * const argv[])
 {
 	char command[MAX_COMMAND_LEN] = { '\0' };
+	char *tokens[MAX_NR_TOKENS];
+	const char *script = NULL;
 	int ret = 0;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "qm")) != -1) {
+	while ((opt = getopt(argc, argv, "qmFTf:")) != -1) {
 		switch (opt) {
 		case 'q':
 			__verbose = false;
@@ -55,9 +148,18 @@ int main(int argc, char * const argv[])
 		case 'm':
 			__color_start = __color_end = "\0";
 			break;
+		case 'f':
+			script = optarg;
+			__verbose = false;
+			break;
 		}
 	}
 
+	if (script && (ret = __open_script(script))) {
+		fprintf(stderr, "Unable to open %s, %s\n", script, strerror(-ret));
+		return EXIT_FAILURE;
+	}
+
 	if ((ret = initialize(argc, argv))) return EXIT_FAILURE;
 
 	/**
@@ -67,14 +169,21 @@ int main(int argc, char * const argv[])
 	setvbuf(stdin, NULL, _IONBF, 0);
 
 	while (true) {
-		char *tokens[MAX_NR_TOKENS] = { NULL };
 		int nr_tokens = 0;
 
 		__print_prompt();
 	
-		if (!fgets(command, sizeof(command), stdin)) break;
+		if (script) {
+			if (!__read_script(command, sizeof(command))) break;
+		} else {
+			if (!fgets(command, sizeof(command), stdin)) break;
+		}
 
 		nr_tokens = parse_command(command, tokens);
+		if (nr_tokens < 0) {
+			fprintf(stderr, "Unterminated quote\n");
+			continue;
+		}
 		if (nr_tokens == 0) continue;
 
 		ret = run_command(nr_tokens, tokens);
@@ -82,12 +191,11 @@ int main(int argc, char * const argv[])
 			fprintf(stderr, "Unable to execute %s\n", tokens[0]);
 		}
 
-		free_command_tokens(tokens);
-
 		if (ret == 0 || ret == -EINVAL) break;
 	}
 
 	finalize(argc, argv);
+	if (script) __close_script();
 
 	return EXIT_SUCCESS;
 }
@@ -15,116 +15,1178 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "list_head.h"
+#include "hash.h"
+#include "parser.h"
+
+/* True if the shell owns the controlling terminal and should hand it over */
+static bool interactive = false;
+
+/* Start every stage with fork() even if it could be spawned (-F) */
+static bool always_fork = false;
+
+/* Print the times of each job when it finishes (-T) */
+static bool report_times = false;
+
+/* posix_spawn() can give the terminal to the child since glibc 2.35 */
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define HAVE_SPAWN_TCSETPGRP
+#endif
+
+/* A command in a pipeline */
+struct stage
+{
+	char **argv;
+	char *path;		/* Resolved path of @argv[0], or NULL to search $PATH */
+};
+
+/***********************************************************************
+ * Aliases
+ *
+ * Aliases are hashed by their keyword. Each alias is a single allocation
+ * that holds the keyword and its expansion already split into words, so
+ * expanding a command only costs one hash lookup per token.
+ */
 struct alias
 {
-	char keyword[100];
-	char command[100][10];
-	int commandCount;
+	struct hlist_node hash;	/* Chained in @alias_table */
+	struct list_head list;	/* Chained in @aliases in the definition order */
+	bool expanding;			/* Set while being expanded to break cycles */
+	char *keyword;
+	int nr_words;
+	char *words[];			/* @nr_words words and NULL; strings follow */
+};
+
+#define ALIAS_HASH_BITS_MIN	6
+
+static LIST_HEAD(aliases);
+static struct hlist_head *alias_table = NULL;
+static unsigned int alias_hash_bits = 0;
+static unsigned int nr_aliases = 0;
+
+static unsigned int hash_string(const char *str)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*str)
+	{
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static struct hlist_head *alias_bucket(const char *keyword)
+{
+	return alias_table + (hash_string(keyword) & ((1u << alias_hash_bits) - 1));
+}
+
+/* Double the hash table once the chains get longer than two on average */
+static int grow_alias_table(void)
+{
+	unsigned int bits = alias_hash_bits ? alias_hash_bits + 1 : ALIAS_HASH_BITS_MIN;
+	struct hlist_head *table = malloc(sizeof(*table) * (1u << bits));
+	struct alias *alias;
+
+	if (!table)
+	{
+		return -1;
+	}
+	for (unsigned int i = 0; i < (1u << bits); i++)
+	{
+		INIT_HLIST_HEAD(table + i);
+	}
+
+	free(alias_table);
+	alias_table = table;
+	alias_hash_bits = bits;
+
+	list_for_each_entry(alias, &aliases, list)
+	{
+		hlist_add_head(&alias->hash, alias_bucket(alias->keyword));
+	}
+	return 0;
+}
+
+static struct alias *find_alias(const char *keyword)
+{
+	struct alias *alias;
+
+	if (!nr_aliases)
+	{
+		return NULL;
+	}
+
+	hlist_for_each_entry(alias, alias_bucket(keyword), hash)
+	{
+		if (strcmp(keyword, alias->keyword) == 0)
+		{
+			return alias;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Define @keyword to expand to @words[0 .. @nr_words - 1]. Redefining an
+ * alias replaces its expansion and keeps its position in the listing.
+ */
+static int define_alias(char *keyword, int nr_words, char *words[])
+{
+	size_t len = strlen(keyword) + 1;
+	struct alias *old = find_alias(keyword);
+	struct alias *alias;
+	char *str;
+
+	for (int i = 0; i < nr_words; i++)
+	{
+		len += strlen(words[i]) + 1;
+	}
+
+	alias = malloc(sizeof(*alias) + sizeof(char *) * (nr_words + 1) + len);
+	if (!alias)
+	{
+		return -1;
+	}
+
+	str = (char *)(alias->words + nr_words + 1);
+	alias->keyword = strcpy(str, keyword);
+	str += strlen(str) + 1;
+
+	for (int i = 0; i < nr_words; i++)
+	{
+		alias->words[i] = strcpy(str, words[i]);
+		str += strlen(str) + 1;
+	}
+	alias->words[nr_words] = NULL;
+	alias->nr_words = nr_words;
+	alias->expanding = false;
+
+	if (old)
+	{
+		hlist_del(&old->hash);
+		list_replace(&old->list, &alias->list);
+		free(old);
+	}
+	else
+	{
+		if ((!alias_table || nr_aliases + 1 > (2u << alias_hash_bits)) &&
+			grow_alias_table())
+		{
+			free(alias);
+			return -1;
+		}
+		list_add_tail(&alias->list, &aliases);
+		nr_aliases++;
+	}
+	hlist_add_head(&alias->hash, alias_bucket(alias->keyword));
+
+	return 0;
+}
+
+static void free_aliases(void)
+{
+	struct alias *alias, *tmp;
+
+	list_for_each_entry_safe(alias, tmp, &aliases, list)
+	{
+		list_del(&alias->list);
+		free(alias);
+	}
+	free(alias_table);
+	alias_table = NULL;
+	alias_hash_bits = 0;
+	nr_aliases = 0;
+}
+
+/**
+ * Put the expansion of the command word @word at @argv[@nr_argv] and return
+ * the new number of words. Nothing is written when @argv is NULL, which
+ * lets the caller size the vector first.
+ *
+ * The first word of an alias is a command word again, so it is expanded
+ * recursively (e.g., alias l ll; alias ll ls -al). An alias that is already
+ * being expanded is taken literally, which terminates alias cycles.
+ */
+static int expand_command_word(char *word, char *argv[], int nr_argv)
+{
+	struct alias *alias = find_alias(word);
+
+	if (!alias || alias->expanding)
+	{
+		if (argv)
+		{
+			argv[nr_argv] = word;
+		}
+		return nr_argv + 1;
+	}
+
+	if (!alias->nr_words)
+	{
+		return nr_argv;
+	}
+
+	alias->expanding = true;
+	nr_argv = expand_command_word(alias->words[0], argv, nr_argv);
+	alias->expanding = false;
+
+	for (int i = 1; i < alias->nr_words; i++)
+	{
+		if (argv)
+		{
+			argv[nr_argv] = alias->words[i];
+		}
+		nr_argv++;
+	}
+	return nr_argv;
+}
+
+/* Substitute aliases in @tokens into @argv. See expand_aliases() */
+static int __expand_aliases(int nr_tokens, char *tokens[], char *argv[])
+{
+	int nr_argv = 0;
+
+	if (!nr_tokens)
+	{
+		return 0;
+	}
+
+	nr_argv = expand_command_word(tokens[0], argv, nr_argv);
+
+	/* Other words are substituted once; the result is not expanded again */
+	for (int i = 1; i < nr_tokens; i++)
+	{
+		struct alias *alias = find_alias(tokens[i]);
+
+		if (!alias)
+		{
+			if (argv)
+			{
+				argv[nr_argv] = tokens[i];
+			}
+			nr_argv++;
+			continue;
+		}
+		if (argv)
+		{
+			memcpy(argv + nr_argv, alias->words, sizeof(*argv) * alias->nr_words);
+		}
+		nr_argv += alias->nr_words;
+	}
+	return nr_argv;
+}
+
+/**
+ * Build the argument vector of a stage by substituting aliases in @tokens.
+ * The vector points into @tokens and the alias table, so only the vector
+ * itself should be freed.
+ */
+static char **expand_aliases(int nr_tokens, char *tokens[])
+{
+	int nr_argv = __expand_aliases(nr_tokens, tokens, NULL);
+	char **argv = malloc(sizeof(*argv) * (nr_argv + 1));
+
+	if (!argv)
+	{
+		return NULL;
+	}
+
+	__expand_aliases(nr_tokens, tokens, argv);
+	argv[nr_argv] = NULL;
+
+	return argv;
+}
+
+/***********************************************************************
+ * Command path cache
+ *
+ * Remember where in $PATH each command was found so that the shell can
+ * execv() the binary directly instead of letting execvp() probe every
+ * directory on each run. Like hash(1) in bash, only successful lookups are
+ * remembered, and the cache is dropped whenever PATH changes.
+ */
+struct command_path
+{
+	struct hlist_node hash;	/* Chained in @command_table */
+	unsigned int hits;
+	char *path;				/* Points into the same allocation */
+	char name[];
+};
+
+#define COMMAND_HASH_BITS	8
+
+/* Keyed by hash_string() of the name, which the buckets spread further */
+static DEFINE_HASHTABLE(command_table, COMMAND_HASH_BITS);
+
+static void flush_command_paths(void)
+{
+	struct command_path *cp;
+	struct hlist_node *tmp;
+	unsigned int bkt;
+
+	hash_for_each_safe(command_table, bkt, tmp, cp, hash)
+	{
+		hash_del(&cp->hash);
+		free(cp);
+	}
+}
+
+/**
+ * Walk $PATH the way execvp() does and cache the first executable @name.
+ * Matches in relative PATH entries depend on the working directory, so they
+ * are not cached.
+ */
+static struct command_path *search_command_path(const char *name)
+{
+	const char *dir = getenv("PATH");
+	size_t name_len = strlen(name);
+
+	if (!dir)
+	{
+		return NULL;
+	}
+
+	while (true)
+	{
+		const char *end = strchrnul(dir, ':');
+		size_t dir_len = end - dir;
+
+		if (dir_len && dir[0] == '/')
+		{
+			struct command_path *cp;
+			struct stat st;
+
+			cp = malloc(sizeof(*cp) + name_len + 1 + dir_len + 1 + name_len + 1);
+			if (!cp)
+			{
+				return NULL;
+			}
+			strcpy(cp->name, name);
+			cp->path = cp->name + name_len + 1;
+			memcpy(cp->path, dir, dir_len);
+			cp->path[dir_len] = '/';
+			strcpy(cp->path + dir_len + 1, name);
+
+			if (stat(cp->path, &st) == 0 && S_ISREG(st.st_mode) &&
+				access(cp->path, X_OK) == 0)
+			{
+				cp->hits = 0;
+				hash_add(command_table, &cp->hash, hash_string(name));
+				return cp;
+			}
+			free(cp);
+		}
+
+		if (!*end)
+		{
+			return NULL;
+		}
+		dir = end + 1;
+	}
+}
+
+/**
+ * Return the full path of the command @name, or NULL if the shell should
+ * leave the lookup to execvp() (e.g., @name contains a slash or is not
+ * found in $PATH).
+ */
+static char *lookup_command_path(const char *name)
+{
+	struct command_path *cp;
+
+	if (strchr(name, '/'))
+	{
+		return NULL;
+	}
+
+	hash_for_each_possible(command_table, cp, hash, hash_string(name))
+	{
+		if (strcmp(name, cp->name) == 0)
+		{
+			goto found;
+		}
+	}
+
+	cp = search_command_path(name);
+	if (!cp)
+	{
+		return NULL;
+	}
+found:
+	cp->hits++;
+	return cp->path;
+}
+
+/***********************************************************************
+ * Jobs
+ *
+ * Every pipeline the shell starts is a job. Children are reaped by the
+ * SIGCHLD handler as soon as they exit, so background jobs never linger as
+ * zombies; the shell only sleeps in sigsuspend() when it has to join a job.
+ * The job list is only modified while SIGCHLD is blocked.
+ */
+struct job_process
+{
+	pid_t pid;
+	bool done;
+	int status;
+};
+
+struct job
+{
+	struct list_head list;	/* Chained in @jobs in the launch order */
+	int id;					/* Job number, as in %1 */
+	pid_t pgid;
+	bool background;
+	int nr_processes;
+	int nr_alive;			/* Processes that are not reaped yet */
+	struct job_process *processes;
+	char *command;			/* Command line for the listing */
+	struct timespec start;	/* Wall clock at the launch and the last exit */
+	struct timespec end;
+	struct timeval utime;	/* CPU times of the reaped processes */
+	struct timeval stime;
 };
 
-struct alias aliases[100];
-int aliasCount = 0;
-int status;
-int returnValue = 0;
+static LIST_HEAD(jobs);
+
+static void block_sigchld(sigset_t *orig)
+{
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, orig);
+}
+
+static void sigchld_handler(int signal)
+{
+	int saved_errno = errno;
+	struct rusage usage;
+	pid_t pid;
+	int status;
+
+	while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0)
+	{
+		struct job *job;
+
+		list_for_each_entry(job, &jobs, list)
+		{
+			for (int i = 0; i < job->nr_processes; i++)
+			{
+				struct job_process *p = job->processes + i;
+
+				if (p->pid == pid && !p->done)
+				{
+					p->done = true;
+					p->status = status;
+					timeradd(&job->utime, &usage.ru_utime, &job->utime);
+					timeradd(&job->stime, &usage.ru_stime, &job->stime);
+					if (!--job->nr_alive)
+					{
+						clock_gettime(CLOCK_MONOTONIC, &job->end);
+					}
+					goto next;
+				}
+			}
+		}
+next:
+		;
+	}
+	errno = saved_errno;
+}
+
+static struct job *create_job(int nr_processes, const char *command)
+{
+	struct job *job = calloc(1, sizeof(*job));
+	struct job *last;
+	int id = 1;
+
+	if (!job)
+	{
+		return NULL;
+	}
+
+	job->processes = calloc(nr_processes, sizeof(*job->processes));
+	job->command = strdup(command);
+	if (!job->processes || !job->command)
+	{
+		free(job->processes);
+		free(job->command);
+		free(job);
+		return NULL;
+	}
+
+	/* Number jobs after the most recent one, starting over when idle */
+	if (!list_empty(&jobs))
+	{
+		last = list_last_entry(&jobs, struct job, list);
+		id = last->id + 1;
+	}
+	job->id = id;
+	list_add_tail(&job->list, &jobs);
+	clock_gettime(CLOCK_MONOTONIC, &job->start);
+	job->end = job->start;
+
+	return job;
+}
+
+static void delete_job(struct job *job)
+{
+	list_del(&job->list);
+	free(job->processes);
+	free(job->command);
+	free(job);
+}
+
+static struct job *find_job(const char *spec)
+{
+	struct job *job;
+	int id;
+
+	if (!spec)
+	{
+		return list_empty(&jobs) ? NULL : list_last_entry(&jobs, struct job, list);
+	}
+
+	id = atoi(spec[0] == '%' ? spec + 1 : spec);
+	list_for_each_entry(job, &jobs, list)
+	{
+		if (job->id == id)
+		{
+			return job;
+		}
+	}
+	return NULL;
+}
+
+/* Print the wall clock and CPU times of finished @job for -T */
+static void print_job_times(struct job *job)
+{
+	double real = (job->end.tv_sec - job->start.tv_sec) +
+			(job->end.tv_nsec - job->start.tv_nsec) / 1e9;
+
+	fprintf(stderr, "real %.3f  user %ld.%03ld  sys %ld.%03ld\t%s\n", real,
+			(long)job->utime.tv_sec, (long)job->utime.tv_usec / 1000,
+			(long)job->stime.tv_sec, (long)job->stime.tv_usec / 1000,
+			job->command);
+}
+
+/**
+ * Wait for @job in the foreground and delete it. Should be called with
+ * SIGCHLD blocked; @orig is the signal mask to sleep with. Return the wait
+ * status of the last process in the pipeline.
+ */
+static int wait_job(struct job *job, const sigset_t *orig)
+{
+	int status;
+
+	if (interactive)
+	{
+		tcsetpgrp(STDIN_FILENO, job->pgid);
+	}
+
+	while (job->nr_alive)
+	{
+		sigsuspend(orig);
+	}
+
+	if (interactive)
+	{
+		tcsetpgrp(STDIN_FILENO, getpgrp());
+	}
+
+	if (report_times)
+	{
+		print_job_times(job);
+	}
+
+	status = job->processes[job->nr_processes - 1].status;
+	delete_job(job);
+
+	return status;
+}
+
+/* Report and forget finished background jobs. Call with SIGCHLD blocked */
+static void reap_jobs(bool verbose)
+{
+	struct job *job, *tmp;
+
+	list_for_each_entry_safe(job, tmp, &jobs, list)
+	{
+		if (job->nr_alive)
+		{
+			continue;
+		}
+		if (verbose)
+		{
+			fprintf(stderr, "[%d]  Done\t%s\n", job->id, job->command);
+		}
+		if (report_times)
+		{
+			print_job_times(job);
+		}
+		delete_job(job);
+	}
+}
+
+/***********************************************************************
+ * Built-in commands
+ *
+ * These run in the shell process itself without forking. Each handler
+ * follows the return convention of run_command().
+ */
+static int builtin_exit(int argc, char *argv[])
+{
+	return 0;
+}
+
+static int builtin_cd(int argc, char *argv[])
+{
+	const char *dir = argv[1];
+
+	if (!dir || strcmp(dir, "~") == 0)
+	{
+		dir = getenv("HOME");
+		if (!dir)
+		{
+			fprintf(stderr, "cd: HOME not set\n");
+			return 1;
+		}
+	}
+
+	if (chdir(dir) < 0)
+	{
+		fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
+	}
+	return 1;
+}
+
+static int builtin_pwd(int argc, char *argv[])
+{
+	char *cwd = getcwd(NULL, 0);
+
+	if (!cwd)
+	{
+		fprintf(stderr, "pwd: %s\n", strerror(errno));
+		return 1;
+	}
+	printf("%s\n", cwd);
+	fflush(stdout);
+	free(cwd);
+
+	return 1;
+}
+
+static int builtin_export(int argc, char *argv[])
+{
+	if (argc == 1)
+	{
+		for (char **env = environ; *env; env++)
+		{
+			printf("%s\n", *env);
+		}
+		fflush(stdout);
+		return 1;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		char *value = strchr(argv[i], '=');
+		char *name;
+
+		/* export NAME without a value keeps the current one */
+		if (!value)
+		{
+			continue;
+		}
+
+		name = strndup(argv[i], value - argv[i]);
+		if (!name)
+		{
+			return -1;
+		}
+		if (setenv(name, value + 1, 1) < 0)
+		{
+			fprintf(stderr, "export: %s: %s\n", name, strerror(errno));
+		}
+		else if (strcmp(name, "PATH") == 0)
+		{
+			flush_command_paths();
+		}
+		free(name);
+	}
+	return 1;
+}
 
-int run_single_command(int nr_tokens, char *tokens[])
+static int builtin_alias(int argc, char *argv[])
 {
-	if (strcmp(tokens[0], "alias") == 0)
+	struct alias *alias;
+
+	if (argc == 1)
 	{
-		if (nr_tokens == 1)
+		list_for_each_entry(alias, &aliases, list)
 		{
-			for (int i = 0; i < aliasCount; i++)
+			fprintf(stderr, "%s:", alias->keyword);
+			for (int i = 0; i < alias->nr_words; i++)
 			{
-				fprintf(stderr, "%s: ", aliases[i].keyword);
-				for (int j = 0; j < aliases[i].commandCount; j++)
-				{
-					fprintf(stderr, "%s ", aliases[i].command[j]);
-				}
-				fprintf(stderr, "\n");
+				fprintf(stderr, " %s", alias->words[i]);
 			}
+			fprintf(stderr, "\n");
 		}
-		else if (nr_tokens > 1)
+		return 1;
+	}
+
+	return define_alias(argv[1], argc - 2, argv + 2) ? -1 : 1;
+}
+
+static int builtin_hash(int argc, char *argv[])
+{
+	if (argc == 1)
+	{
+		struct command_path *cp;
+		unsigned int bkt;
+
+		hash_for_each(command_table, bkt, cp, hash)
 		{
-			strcpy(aliases[aliasCount].keyword, tokens[1]);
-			aliases[aliasCount].commandCount = 0;
-			for (int i = 2; i < nr_tokens; i++)
-			{
-				strcpy(aliases[aliasCount].command[i - 2], tokens[i]);
-				aliases[aliasCount].commandCount++;
-			}
-			aliasCount++;
+			printf("%4u\t%s\n", cp->hits, cp->path);
+		}
+		fflush(stdout);
+		return 1;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-r") == 0)
+		{
+			flush_command_paths();
+		}
+		else if (!lookup_command_path(argv[i]) && !strchr(argv[i], '/'))
+		{
+			fprintf(stderr, "hash: %s: not found\n", argv[i]);
 		}
 	}
+	return 1;
+}
+
+static int builtin_jobs(int argc, char *argv[])
+{
+	struct job *job;
+	sigset_t orig;
+
+	block_sigchld(&orig);
+	list_for_each_entry(job, &jobs, list)
+	{
+		fprintf(stderr, "[%d]  %s\t%s\n", job->id,
+				job->nr_alive ? "Running" : "Done", job->command);
+	}
+	reap_jobs(false);
+	sigprocmask(SIG_SETMASK, &orig, NULL);
+
+	return 1;
+}
+
+static int builtin_fg(int argc, char *argv[])
+{
+	struct job *job;
+	sigset_t orig;
+
+	block_sigchld(&orig);
+	job = find_job(argv[1]);
+	if (job)
+	{
+		fprintf(stderr, "%s\n", job->command);
+		job->background = false;
+		wait_job(job, &orig);
+	}
 	else
 	{
-		char *newTokens[32] = {NULL};
-		int top = 0;
+		fprintf(stderr, "fg: %s: no such job\n", argv[1] ? argv[1] : "current");
+	}
+	sigprocmask(SIG_SETMASK, &orig, NULL);
 
-		for (int i = 0; i < nr_tokens; i++)
+	return 1;
+}
+
+static int builtin_wait(int argc, char *argv[])
+{
+	struct job *job, *tmp;
+	sigset_t orig;
+
+	block_sigchld(&orig);
+	if (argc == 1)
+	{
+		list_for_each_entry_safe(job, tmp, &jobs, list)
 		{
-			int isAlias = 0;
-			for (int j = 0; j < aliasCount; j++)
-			{
-				if (strcmp(tokens[i], aliases[j].keyword) == 0)
-				{
-					// alias word
-					isAlias = 1;
-					for (int k = 0; k < aliases[j].commandCount; k++)
-					{
-						newTokens[top++] = strdup(aliases[j].command[k]);
-					}
-					break;
-				}
-			}
-			// no alias word
-			if (isAlias == 0)
-			{
-				newTokens[top++] = strdup(tokens[i]);
-			}
-			isAlias = 0;
+			wait_job(job, &orig);
+		}
+	}
+	for (int i = 1; i < argc; i++)
+	{
+		job = find_job(argv[i]);
+		if (!job)
+		{
+			fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+			continue;
+		}
+		wait_job(job, &orig);
+	}
+	sigprocmask(SIG_SETMASK, &orig, NULL);
+
+	return 1;
+}
+
+struct builtin
+{
+	const char *name;
+	int (*run)(int argc, char *argv[]);
+	bool raw; /* Takes the arguments as typed, without alias substitution */
+};
+
+static const struct builtin builtins[] = {
+	{ .name = "exit", .run = builtin_exit, },
+	{ .name = "cd", .run = builtin_cd, },
+	{ .name = "pwd", .run = builtin_pwd, },
+	{ .name = "export", .run = builtin_export, },
+	{ .name = "hash", .run = builtin_hash, },
+	{ .name = "jobs", .run = builtin_jobs, },
+	{ .name = "fg", .run = builtin_fg, },
+	{ .name = "wait", .run = builtin_wait, },
+	{ .name = "alias", .run = builtin_alias, .raw = true, },
+};
+
+static const struct builtin *find_builtin(const char *name)
+{
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(*builtins); i++)
+	{
+		if (strcmp(name, builtins[i].name) == 0)
+		{
+			return builtins + i;
 		}
+	}
+	return NULL;
+}
+
+static int count_args(char *argv[])
+{
+	int argc = 0;
+
+	while (argv[argc])
+	{
+		argc++;
+	}
+	return argc;
+}
+
+/**
+ * Body of a forked stage. Never returns to the shell.
+ */
+static void exec_stage(struct stage *stage)
+{
+	char **argv = stage->argv;
+	const struct builtin *builtin;
+
+	if (!argv[0])
+	{
+		_exit(EXIT_SUCCESS);
+	}
+
+	/* A builtin in a pipeline runs in the forked child */
+	builtin = find_builtin(argv[0]);
+	if (builtin)
+	{
+		/* The shell's jobs are not children of this process */
+		INIT_LIST_HEAD(&jobs);
+		builtin->run(count_args(argv), argv);
+		fflush(stdout);
+		_exit(EXIT_SUCCESS);
+	}
+
+	/* Fall back to execvp() if the cached binary has been removed since */
+	if (!stage->path || (execv(stage->path, argv) < 0 && errno == ENOENT))
+	{
+		execvp(argv[0], argv);
+	}
+
+	/**
+	 * Use _exit() so that the child neither flushes the stdio buffers it
+	 * shares with the shell nor falls back into the shell's main loop.
+	 */
+	fprintf(stderr, "Unable to execute %s\n", argv[0]);
+	_exit(EXIT_FAILURE);
+}
+
+static void close_pipes(int nr_pipes, int pipes[][2])
+{
+	for (int i = 0; i < nr_pipes; i++)
+	{
+		close(pipes[i][0]);
+		close(pipes[i][1]);
+	}
+}
+
+/**
+ * Check whether @stage only has to exec a binary, so that it can be started
+ * with posix_spawn() instead of forking the whole shell. Builtins need the
+ * shell code in the child, and so does the terminal hand-over of a
+ * @foreground job unless the C library can do it for us.
+ */
+static bool can_spawn(struct stage *stage, bool foreground)
+{
+	if (always_fork || !stage->argv[0] || find_builtin(stage->argv[0]))
+	{
+		return false;
+	}
+#ifndef HAVE_SPAWN_TCSETPGRP
+	if (interactive && foreground)
+	{
+		return false;
+	}
+#endif
+	return true;
+}
+
+/**
+ * Start the @i-th @stage of a pipeline with posix_spawn(). The C library
+ * does vfork() and exec() in one go, so the shell's page tables, which grow
+ * with the alias table and the command path cache, are never copied. The
+ * child does what the forked one would do in its body: joins the process
+ * group @pgid, takes the terminal if @foreground, resets the signals the
+ * shell handles, restores @mask, and hooks its stdin/stdout to the pipes.
+ *
+ * Return the pid of the child, or 0 if the command could not be executed.
+ */
+static pid_t spawn_stage(struct stage *stage, int i, int nr_pipes, int pipes[][2],
+		pid_t pgid, bool foreground, const sigset_t *mask)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t sigdefault;
+	pid_t pid = 0;
+	int err = ENOENT;
+
+	posix_spawn_file_actions_init(&actions);
+	if (i > 0)
+	{
+		posix_spawn_file_actions_adddup2(&actions, pipes[i - 1][0], STDIN_FILENO);
+	}
+	if (i < nr_pipes)
+	{
+		posix_spawn_file_actions_adddup2(&actions, pipes[i][1], STDOUT_FILENO);
+	}
+	for (int j = 0; j < nr_pipes; j++)
+	{
+		posix_spawn_file_actions_addclose(&actions, pipes[j][0]);
+		posix_spawn_file_actions_addclose(&actions, pipes[j][1]);
+	}
+#ifdef HAVE_SPAWN_TCSETPGRP
+	if (interactive && foreground)
+	{
+		posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+	}
+#endif
 
-		nr_tokens = top;
-		pid_t pid = fork();
+	sigemptyset(&sigdefault);
+	sigaddset(&sigdefault, SIGTTOU);
+	sigaddset(&sigdefault, SIGCHLD);
 
-		if (pid > 0)
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK | POSIX_SPAWN_SETPGROUP |
+			POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+	posix_spawnattr_setpgroup(&attr, pgid);
+	posix_spawnattr_setsigmask(&attr, mask);
+	posix_spawnattr_setsigdefault(&attr, &sigdefault);
+
+	/* Fall back to searching $PATH if the cached binary has been removed since */
+	if (stage->path)
+	{
+		err = posix_spawn(&pid, stage->path, &actions, &attr, stage->argv, environ);
+	}
+	if (err == ENOENT)
+	{
+		err = posix_spawnp(&pid, stage->argv[0], &actions, &attr, stage->argv, environ);
+	}
+	if (err)
+	{
+		fprintf(stderr, "Unable to execute %s\n", stage->argv[0]);
+		pid = 0;
+	}
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	return pid;
+}
+
+/**
+ * Run @nr_stages stages connected with pipes as the job @command. All pipes
+ * are created first, then every stage is started in a single process group
+ * so that they run concurrently; exec-only stages are spawned without
+ * fork(). A foreground job is waited for before returning, whereas a
+ * @background one keeps running while the shell goes on.
+ *
+ * Return the wait status of the last stage of a foreground job, 0 for a
+ * background job, or -1 if the pipeline could not be set up.
+ */
+static int run_pipeline(int nr_stages, struct stage stages[], bool background,
+		const char *command)
+{
+	int nr_pipes = nr_stages - 1;
+	int (*pipes)[2] = NULL;
+	struct job *job;
+	sigset_t orig;
+	int status = 0;
+
+	if (nr_pipes)
+	{
+		pipes = malloc(sizeof(*pipes) * nr_pipes);
+		if (!pipes)
 		{
-			wait(&status);
+			return -1;
 		}
+	}
+
+	for (int i = 0; i < nr_pipes; i++)
+	{
+		if (pipe(pipes[i]) < 0)
+		{
+			close_pipes(i, pipes);
+			free(pipes);
+			return -1;
+		}
+	}
+
+	/* Keep the handler from reaping the stages before they are recorded */
+	block_sigchld(&orig);
+
+	job = create_job(nr_stages, command);
+	if (!job)
+	{
+		status = -1;
+		goto out;
+	}
+	job->background = background;
+
+	for (; job->nr_processes < nr_stages; job->nr_processes++)
+	{
+		int i = job->nr_processes;
+		pid_t pid;
 
+		if (can_spawn(stages + i, !background))
+		{
+			pid = spawn_stage(stages + i, i, nr_pipes, pipes, job->pgid, !background, &orig);
+			if (!pid)
+			{
+				/* Account the stage as if its exec() had failed in the child */
+				job->processes[i].done = true;
+				job->processes[i].status = EXIT_FAILURE << 8;
+				continue;
+			}
+		}
+		else if ((pid = fork()) < 0)
+		{
+			status = -1;
+			break;
+		}
 		else if (pid == 0)
 		{
-			if (strcmp(newTokens[0], "cd") == 0)
+			setpgid(0, job->pgid);
+			if (interactive && !background)
 			{
-				char *homedir = getenv("HOME");
-				if (nr_tokens == 1 || strcmp(newTokens[1], "~") == 0)
-				{
-					chdir(homedir);
-				}
-				else
-				{
-					chdir(newTokens[1]);
-				}
+				tcsetpgrp(STDIN_FILENO, job->pgid ? job->pgid : getpid());
 			}
+			signal(SIGTTOU, SIG_DFL);
+			signal(SIGCHLD, SIG_DFL);
+			sigprocmask(SIG_SETMASK, &orig, NULL);
 
-			else
+			if (i > 0)
 			{
-				returnValue = execvp(newTokens[0], newTokens);
-
-				if (returnValue < 0)
-				{
-					return -1;
-					exit(-1);
-				}
+				dup2(pipes[i - 1][0], STDIN_FILENO);
+			}
+			if (i < nr_pipes)
+			{
+				dup2(pipes[i][1], STDOUT_FILENO);
 			}
+			close_pipes(nr_pipes, pipes);
+
+			exec_stage(stages + i);
 		}
+
+		/* Set the group on both sides to close the race with exec() */
+		if (!job->pgid)
+		{
+			job->pgid = pid;
+		}
+		setpgid(pid, job->pgid);
+		job->processes[i].pid = pid;
+		job->nr_alive++;
 	}
-	return 1;
+
+	/* Pipes should be closed here so that the readers will see EOF */
+	close_pipes(nr_pipes, pipes);
+	nr_pipes = 0;
+
+	if (!job->nr_processes)
+	{
+		delete_job(job);
+	}
+	else if (background && status == 0)
+	{
+		fprintf(stderr, "[%d] %d\n", job->id, job->pgid);
+	}
+	else
+	{
+		int ret = wait_job(job, &orig);
+
+		status = status < 0 ? status : ret;
+	}
+
+out:
+	sigprocmask(SIG_SETMASK, &orig, NULL);
+	close_pipes(nr_pipes, pipes);
+	free(pipes);
+
+	return status;
+}
+
+/* Join @tokens with spaces into a newly allocated string */
+static char *join_tokens(int nr_tokens, char *tokens[])
+{
+	size_t len = 0;
+	char *str, *pos;
+
+	for (int i = 0; i < nr_tokens; i++)
+	{
+		len += strlen(tokens[i]) + 1;
+	}
+
+	str = pos = malloc(len + 1);
+	if (!str)
+	{
+		return NULL;
+	}
+
+	for (int i = 0; i < nr_tokens; i++)
+	{
+		pos = stpcpy(pos, tokens[i]);
+		*pos++ = ' ';
+	}
+	*(pos > str ? pos - 1 : pos) = '\0';
+
+	return str;
 }
 
 /***********************************************************************
@@ -141,39 +1203,107 @@ int run_single_command(int nr_tokens, char *tokens[])
  */
 int run_command(int nr_tokens, char *tokens[])
 {
-	char *newTokens[32] = {NULL};
-	int countToken = 0;
+	const struct builtin *builtin;
+	struct stage *stages;
+	bool background = false;
+	int nr_stages = 1;
+	int start = 0;
+	int ret = 1;
 
-	for (int i = 0; i < nr_tokens; i++)
+	/* Forget finished jobs before each command, telling only on a terminal */
+	{
+		sigset_t orig;
+
+		block_sigchld(&orig);
+		reap_jobs(interactive);
+		sigprocmask(SIG_SETMASK, &orig, NULL);
+	}
+
+	/* A trailing & runs the command in the background */
+	if (tokens[nr_tokens - 1] == background_token)
 	{
-		if (strcmp(tokens[i], "|") == 0)
+		background = true;
+		if (--nr_tokens == 0)
 		{
-			returnValue = run_single_command(countToken, newTokens);
-			for (int j = 0; j < 32; j++)
-			{
-				free(newTokens[j]);
-				newTokens[j] = NULL;
-			}
-			countToken = 0;
+			return -1;
 		}
-		else
+	}
+
+	for (int i = 0; i < nr_tokens; i++)
+	{
+		if (tokens[i] == pipe_token)
 		{
-			newTokens[countToken++] = strdup(tokens[i]);
+			nr_stages++;
 		}
 	}
 
-	returnValue = run_single_command(countToken, newTokens);
+	builtin = find_builtin(tokens[0]);
+	if (nr_stages == 1 && !background && builtin && builtin->raw)
+	{
+		return builtin->run(nr_tokens, tokens);
+	}
 
-	if (returnValue == -1)
+	stages = calloc(nr_stages, sizeof(*stages));
+	if (!stages)
 	{
 		return -1;
 	}
-	else if (returnValue == 0 || strcmp(tokens[0], "exit") == 0)
+
+	/* Split @tokens at each | and expand aliases in every stage */
+	nr_stages = 0;
+	for (int i = 0; i <= nr_tokens; i++)
 	{
-		return 0;
-		exit(0);
+		if (i < nr_tokens && tokens[i] != pipe_token)
+		{
+			continue;
+		}
+
+		stages[nr_stages].argv = expand_aliases(i - start, tokens + start);
+		if (!stages[nr_stages].argv)
+		{
+			ret = -1;
+			goto out;
+		}
+		nr_stages++;
+		start = i + 1;
 	}
-	return 1;
+
+	/* A lone builtin runs in the shell without forking */
+	builtin = stages[0].argv[0] ? find_builtin(stages[0].argv[0]) : NULL;
+	if (nr_stages == 1 && !background && builtin)
+	{
+		ret = builtin->run(count_args(stages[0].argv), stages[0].argv);
+	}
+	else
+	{
+		char *command = join_tokens(nr_tokens, tokens);
+
+		/* Resolve the commands here so the parent's cache gets filled */
+		for (int i = 0; i < nr_stages; i++)
+		{
+			char *name = stages[i].argv[0];
+
+			if (name && !find_builtin(name))
+			{
+				stages[i].path = lookup_command_path(name);
+			}
+		}
+
+		if (!command || run_pipeline(nr_stages, stages, background, command) < 0)
+		{
+			ret = -1;
+		}
+		free(command);
+	}
+
+out:
+	for (int i = 0; i < nr_stages; i++)
+	{
+		free(stages[i].argv);
+	}
+	free(stages);
+
+	return ret;
 }
 
 /***********************************************************************
@@ -189,7 +1319,37 @@ int run_command(int nr_tokens, char *tokens[])
  */
 int initialize(int argc, char *const argv[])
 {
-	return 0;
+	struct sigaction sa = {
+		.sa_handler = sigchld_handler,
+		.sa_flags = SA_RESTART | SA_NOCLDSTOP,
+	};
+	int opt;
+
+	/* mash.c has parsed the other options already */
+	optind = 1;
+	opterr = 0;
+	while ((opt = getopt(argc, argv, "FTf:")) != -1)
+	{
+		if (opt == 'F')
+		{
+			always_fork = true;
+		}
+		else if (opt == 'T')
+		{
+			report_times = true;
+		}
+	}
+
+	interactive = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+
+	/* Let the shell take the terminal back from finished pipelines */
+	if (interactive)
+	{
+		signal(SIGTTOU, SIG_IGN);
+	}
+
+	sigemptyset(&sa.sa_mask);
+	return sigaction(SIGCHLD, &sa, NULL);
 }
 
 /***********************************************************************
@@ -201,4 +1361,6 @@ int initialize(int argc, char *const argv[])
  */
 void finalize(int argc, char *const argv[])
 {
+	free_aliases();
+	flush_command_paths();
 }
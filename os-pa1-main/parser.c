@@ -13,31 +13,90 @@
  *
  **********************************************************************/
 
+#include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
-#include <stdlib.h>
 
 #include "parser.h"
 
-int parse_command(char *command, char *tokens[])
+char pipe_token[] = "|";
+char background_token[] = "&";
+
+/**
+ * Copy the token starting at @curr to @out while removing quotes and
+ * backslashes. @out never goes past @curr, so the dequoted token can be
+ * built in place. Return the position after the token, or NULL if a quote
+ * is left open.
+ */
+static char *__scan_token(char *curr, char *out, char **end)
 {
-	const char *delimiters = " \t\r\f\r\n\v";
-	char *curr;
-	int nr_tokens = 0;
+	while (*curr && !isspace((unsigned char)*curr)) {
+		char quote;
 
-	while ((curr = strtok(command, delimiters))) {
-		*tokens++ = strdup(curr);
-		nr_tokens++;
-		command = NULL;
+		switch (*curr) {
+		case '\\':
+			curr++;
+			if (*curr == '\n') {
+				/* Backslash-newline is a line continuation */
+				curr++;
+			} else if (*curr) {
+				*out++ = *curr++;
+			}
+			break;
+		case '\'':
+		case '"':
+			quote = *curr++;
+			while (*curr && *curr != quote) {
+				/* Only a few characters are escaped within "..." */
+				if (quote == '"' && *curr == '\\' &&
+						curr[1] && strchr("\"\\$`", curr[1])) {
+					curr++;
+				}
+				*out++ = *curr++;
+			}
+			if (!*curr) return NULL;
+			curr++;
+			break;
+		default:
+			*out++ = *curr++;
+		}
 	}
-	*tokens = NULL;
-
-	return nr_tokens;
+	*end = out;
+	return curr;
 }
 
-void free_command_tokens(char *tokens[])
+int parse_command(char *command, char *tokens[])
 {
-	for (char *token = *tokens; token; token = *(++tokens)) {
-		free(token);
+	char *curr = command;	/* Next character to scan */
+	char *out = command;	/* Where the next dequoted character goes */
+	int nr_tokens = 0;
+
+	while (true) {
+		char *end;
+
+		/* Skip the whitespaces between tokens */
+		while (*curr && isspace((unsigned char)*curr)) curr++;
+		if (!*curr) break;
+
+		/* A bare | or & is an operator; quoted or escaped, it is a word */
+		if ((*curr == '|' || *curr == '&') &&
+				(!curr[1] || isspace((unsigned char)curr[1]))) {
+			tokens[nr_tokens++] = *curr == '|' ? pipe_token : background_token;
+			curr++;
+			continue;
+		}
+
+		tokens[nr_tokens++] = out;
+
+		curr = __scan_token(curr, out, &end);
+		if (!curr) return -1;
+
+		/* Step over the delimiter before it may get overwritten by '\0' */
+		if (*curr) curr++;
+		*end = '\0';
+		out = end + 1;
 	}
+	tokens[nr_tokens] = NULL;
+
+	return nr_tokens;
 }
@@ -16,10 +16,19 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
-#define MAX_NR_TOKENS	32	/* Maximum length of tokens in a command */
 #define MAX_TOKEN_LEN	128	/* Maximum length of single token */
 #define MAX_COMMAND_LEN	4096 /* Maximum length of assembly string */
 
+/* Maximum number of tokens in a command (including the NULL terminator) */
+#define MAX_NR_TOKENS	(MAX_COMMAND_LEN / 2 + 1)
+
+/**
+ * parse_command() returns an unquoted | or & as these very strings, so an
+ * operator is told from a quoted "|" or "&" word by comparing the pointers.
+ */
+extern char pipe_token[];
+extern char background_token[];
+
 
 /***********************************************************************
  * parse_command()
@@ -38,26 +47,23 @@
  *    tokens[3] = "/path/to/dest"
  *    tokens[>=4] = NULL
  *
- *  Each token is allocated from the heap, so you need to deallcate them by 
- *  calling @free_command_tokens after use.
+ *  Whitespaces can be put in a token by quoting them with '...' or "...", or
+ *  by escaping them with a backslash. Within "...", a backslash only escapes
+ *  ", \, $, and `. For example, echo "a  b" 'c\d' e\ f gives the tokens
+ *  "echo", "a  b", "c\d", and "e f".
+ *  Quoting also keeps | and & from acting as operators; only the unquoted
+ *  ones are put in @tokens[] as pipe_token and background_token.
+ *
+ *  The tokens are built in place in @command, so no memory is allocated and
+ *  the tokens stay valid until @command is overwritten. @tokens[] should have
+ *  room for (strlen(@command) + 1) / 2 + 1 entries, which MAX_NR_TOKENS
+ *  covers for any command read into a buffer of MAX_COMMAND_LEN.
  *
  * RETURN VALUE
  *  Return the number of @tokens[]
+ *  Return -1 if a quote is not closed
  *
  */
 int parse_command(char *command, char *tokens[]);
 
-
-/***********************************************************************
- * free_commmand_tokens()
- *
- * DESCRIPTION
- *  Deallocate @tokens.
- *
- * HINT
- *  Actually this function does not care whether the entries in @tokens are
- *  allocated from @parse_command() or somewhere else ;-)
- */
-void free_command_tokens(char *tokens[]);
-
 #endif
@@ -0,0 +1,203 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "list_head.h"
+
+#include "sched.h"
+
+/**
+ * Simulate every scheduler against every script, several at once
+ */
+struct run {
+	struct scheduler *sched;
+	const char *scriptfile;
+
+	bool ok;
+	struct sched_stats stats;
+};
+
+static struct run *__runs = NULL;
+static unsigned int __nr_runs = 0;
+
+/* The next run to pick up. Protected by @__runs_lock */
+static unsigned int __next_run = 0;
+static pthread_mutex_t __runs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Options applied to every run */
+static unsigned int __nr_cpus = 1;
+static const char *__balance = "idle";
+
+static struct run *__pick_run(void)
+{
+	struct run *run = NULL;
+
+	pthread_mutex_lock(&__runs_lock);
+	if (__next_run < __nr_runs)
+		run = __runs + __next_run++;
+	pthread_mutex_unlock(&__runs_lock);
+
+	return run;
+}
+
+static void *__run_simulations(void *arg)
+{
+	struct run *run;
+
+	while ((run = __pick_run())) {
+		struct simulation simulation;
+
+		init_simulation(&simulation);
+
+		sim->sched = run->sched;
+		quiet = true;
+		sim->trace = false;
+		sim->event_driven = true;
+		nr_cpus = __nr_cpus;
+		set_balance(__balance);
+
+		run->ok = run_simulation(run->scriptfile);
+		run->stats = sim->stats;
+		free_stats(&run->stats);
+	}
+	return NULL;
+}
+
+static void __print_run(struct run *run)
+{
+	struct sched_stats *stats = &run->stats;
+	unsigned int nr = stats->nr_exited ? stats->nr_exited : 1;
+
+	printf("%-31s  %-24s  ", run->sched->name, run->scriptfile);
+	if (!run->ok) {
+		printf("failed\n");
+		return;
+	}
+
+	printf("%8u  %10.2f  %8.2f  %8lu  %8lu\n", stats->makespan,
+	       (double)stats->turnaround / nr, (double)stats->wait / nr,
+	       stats->nr_switches, stats->blocked);
+}
+
+static void __print_usage(char *const name)
+{
+	printf("Usage: %s {-j JOBS} {-n NCPUS} {-b BALANCE} {-P SCHEDULERS} [process script file ...]\n", name);
+	printf("\n");
+	printf("  -j: Run JOBS simulations at once (default: # of online processors)\n");
+	printf("  -n: Simulate NCPUS processors (default 1)\n");
+	printf("  -b: Balance the load of processors with BALANCE (see sched -h)\n");
+	printf("  -P: Run the schedulers of the letters in SCHEDULERS (default fsSrpaci)\n");
+	printf("\n");
+	printf("Each script is simulated with each scheduler, and the makespan, the average\n");
+	printf("turnaround and waiting ticks of processes, the number of context switches, and\n");
+	printf("the total ticks processes are blocked for resources are reported.\n");
+	printf("\n");
+}
+
+int main(int argc, char *const argv[])
+{
+	const char *schedulers = "fsSrpaci";
+	long nr_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	struct simulation simulation;
+	pthread_t *jobs;
+	bool ok = true;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "j:n:b:P:h")) != -1) {
+		switch (opt) {
+		case 'j':
+			nr_jobs = atoi(optarg);
+			break;
+		case 'n':
+			__nr_cpus = atoi(optarg);
+			break;
+		case 'b':
+			__balance = optarg;
+			break;
+		case 'P':
+			schedulers = optarg;
+			break;
+		case 'h':
+		default:
+			__print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Validate the options once rather than in every run */
+	init_simulation(&simulation);
+	if (nr_jobs < 1 || __nr_cpus < 1 || !set_balance(__balance) ||
+			!*schedulers || optind >= argc) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	__runs = calloc(strlen(schedulers) * (argc - optind), sizeof(*__runs));
+	if (!__runs) {
+		return EXIT_FAILURE;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		for (const char *s = schedulers; *s; s++) {
+			struct run *run = __runs + __nr_runs++;
+
+			run->sched = lookup_scheduler(*s);
+			if (!run->sched) {
+				fprintf(stderr, "Unknown scheduler %c\n", *s);
+				return EXIT_FAILURE;
+			}
+			run->scriptfile = argv[i];
+		}
+	}
+
+	if (nr_jobs > __nr_runs)
+		nr_jobs = __nr_runs;
+
+	jobs = calloc(nr_jobs, sizeof(*jobs));
+	if (!jobs) {
+		return EXIT_FAILURE;
+	}
+
+	for (long i = 0; i < nr_jobs; i++) {
+		if (pthread_create(jobs + i, NULL, __run_simulations, NULL)) {
+			fprintf(stderr, "Unable to start job %ld\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (long i = 0; i < nr_jobs; i++) {
+		pthread_join(jobs[i], NULL);
+	}
+
+	printf("%-31s  %-24s  %8s  %10s  %8s  %8s  %8s\n", "scheduler", "script",
+	       "makespan", "turnaround", "wait", "switches", "blocked");
+	for (unsigned int i = 0; i < __nr_runs; i++) {
+		__print_run(__runs + i);
+		if (!__runs[i].ok)
+			ok = false;
+	}
+
+	free(jobs);
+	free(__runs);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
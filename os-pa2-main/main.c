@@ -0,0 +1,135 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "list_head.h"
+
+#include "sched.h"
+
+static void __print_usage(char *const name)
+{
+	printf("Usage: %s {-q|-Q} {-e} {-n NCPUS} {-b BALANCE} {-o FILE} {--stats FORMAT} -[f|s|S|r|a|p|i] [process script file]\n", name);
+	printf("\n");
+	printf("  -q: Run quietly. With --stats, the events are not traced either\n");
+	printf("  -Q: Run quietly without tracing events\n");
+	printf("  -e: Skip uneventful ticks in the simulation\n");
+	printf("  -n: Simulate NCPUS processors (default 1)\n");
+	printf("  -b: Balance the load of processors with BALANCE, which is\n");
+	printf("      none: Never move processes between processors\n");
+	printf("      idle: Idle processors steal from the busiest one (default)\n");
+	printf("      N   : Also even out the ready queues every N ticks\n");
+	printf("  -o: Write the trace of events to FILE in binary. See sched-trace\n");
+	printf("  --stats: Print the statistics in FORMAT, json or csv, at the end\n\n");
+	printf("  -f: Use FCFS scheduler (default)\n");
+	printf("  -s: Use SJF scheduler\n");
+	printf("  -S: Use STCF scheduler\n");
+	printf("  -r: Use Round-robin scheduler\n");
+	printf("  -p: Use Priority scheduler\n");
+	printf("  -a: Use Priority scheduler with aging\n");
+	printf("  -c: Use Priority scheduler with PCP\n");
+	printf("  -i: Use Priority scheduler with PIP\n");
+	printf("\n");
+}
+
+static const struct option __options[] = {
+	{ "stats", required_argument, NULL, 'x' },
+	{ NULL, 0, NULL, 0 },
+};
+
+int main(int argc, char *const argv[])
+{
+	struct simulation simulation;
+	enum stats_format stats = STATS_NONE;
+	int opt;
+
+	init_simulation(&simulation);
+
+	while ((opt = getopt_long(argc, argv, "qQen:b:o:fsSrpaich", __options, NULL)) != -1) {
+		switch (opt) {
+		case 'q':
+			quiet = true;
+			break;
+		case 'Q':
+			quiet = true;
+			sim->trace = false;
+			break;
+		case 'e':
+			sim->event_driven = true;
+			break;
+		case 'n':
+			nr_cpus = atoi(optarg);
+			if (nr_cpus < 1) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			if (!set_balance(optarg)) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'o':
+			sim->trace_filename = optarg;
+			break;
+		case 'x':
+			if (!strcmp(optarg, "json")) {
+				stats = STATS_JSON;
+			} else if (!strcmp(optarg, "csv")) {
+				stats = STATS_CSV;
+			} else {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'h':
+			__print_usage(argv[0]);
+			return EXIT_FAILURE;
+		default:
+			sim->sched = lookup_scheduler(opt);
+			if (!sim->sched) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		}
+	}
+
+	if (optind >= argc) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* The statistics are all that is wanted. Do no I/O while simulating */
+	if (quiet && stats != STATS_NONE)
+		sim->trace = false;
+
+	if (!run_simulation(argv[optind])) {
+		free_stats(&sim->stats);
+		return EXIT_FAILURE;
+	}
+
+	print_stats(stdout, stats);
+	free_stats(&sim->stats);
+
+	return EXIT_SUCCESS;
+}
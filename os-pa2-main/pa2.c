@@ -22,31 +22,19 @@
 #include "list_head.h"
 
 /**
- * The process which is currently running
+ * The process which is currently running, @current, and the list head to
+ * hold the processes ready to run, @readyqueue, are defined in sched.h
  */
 #include "process.h"
-extern struct process *current;
 
 /**
- * List head to hold the processes ready to run
- */
-extern struct list_head readyqueue;
-
-/**
- * Resources in the system.
+ * Resources in the system, @resources[NR_RESOURCES], the monotonically
+ * increasing @ticks (do not modify it), and the quiet mode @quiet, which is
+ * true if the program was started with -q option, are in sched.h as well
  */
 #include "resource.h"
-extern struct resource resources[NR_RESOURCES];
-
-/**
- * Monotonically increasing ticks. Do not modify it
- */
-extern unsigned int ticks;
 
-/**
- * Quiet mode. True if the program was started with -q option
- */
-extern bool quiet;
+#include "sched.h"
 
 /***********************************************************************
  * Default FCFS resource acquision function
@@ -128,12 +116,10 @@ static void fcfs_release(int resource_id)
 		 * Put the waiter process into ready queue. The framework will
 		 * do the rest.
 		 */
-		list_add_tail(&waiter->list, &readyqueue);
+		enqueue_ready(waiter);
 	}
 }
 
-#include "sched.h"
-
 /***********************************************************************
  * FCFS scheduler
  ***********************************************************************/
@@ -174,20 +160,20 @@ static struct process *fcfs_schedule(void)
 pick_next:
 	/* Let's pick a new process to run next */
 
-	if (!list_empty(&readyqueue))
+	/**
+	 * If the ready queue is not empty, pick the first process
+	 * in the ready queue
+	 */
+	next = peek_ready();
+	if (next)
 	{
 		/**
-		 * If the ready queue is not empty, pick the first process
-		 * in the ready queue
+		 * Detach the process from the ready queue. Use dequeue_ready()
+		 * over list_del() to keep the ready queue index in sync and the
+		 * list head tidy. Otherwise, the framework will complain (assert)
+		 * on process exit.
 		 */
-		next = list_first_entry(&readyqueue, struct process, list);
-
-		/**
-		 * Detach the process from the ready queue. Note that we use
-		 * list_del_init() over list_del() to maintain the list head tidy.
-		 * Otherwise, the framework will complain (assert) on process exit.
-		 */
-		list_del_init(&next->list);
+		dequeue_ready(next);
 	}
 
 	/* Return the process to run next */
@@ -196,6 +182,7 @@ pick_next:
 
 struct scheduler fcfs_scheduler = {
 	.name = "FCFS",
+	.quantum = UINT_MAX,
 	.acquire = fcfs_acquire,
 	.release = fcfs_release,
 	.initialize = fcfs_initialize,
@@ -221,28 +208,19 @@ static struct process *sjf_schedule(void)
 	}
 
 pick_next:
-	if (!list_empty(&readyqueue))
+	/* The ready queue is indexed by lifespan, so the head is the shortest */
+	next = peek_ready();
+	if (next)
 	{
-		/*readyqueue가 비어있지않으면 shortest time 찾아서 next에 넣기*/
-		/*readyqueue에 들어있는 프로세스 비교 - for lifespan이 가장 짧은 process 찾기*/
-		struct process *tmp = NULL;
-		unsigned int min = UINT_MAX;
-
-		list_for_each_entry(tmp, &readyqueue, list)
-		{
-			if (tmp->lifespan < min)
-			{
-				min = tmp->lifespan;
-				next = tmp;
-			}
-		}
-		list_del_init(&next->list);
+		dequeue_ready(next);
 	}
 	return next;
 }
 
 struct scheduler sjf_scheduler = {
 	.name = "Shortest-Job First",
+	.quantum = UINT_MAX,
+	.rq = &lifespan_heap_rq,
 	.acquire = fcfs_acquire,  /* Use the default FCFS acquire() */
 	.release = fcfs_release,  /* Use the default FCFS release() */
 	.schedule = sjf_schedule, /* TODO: Assign your schedule function
@@ -259,73 +237,34 @@ static struct process *stcf_schedule(void)
 {
 	struct process *next = NULL;
 
-	if (!current || current->status == PROCESS_BLOCKED)
+	if (!current || current->status == PROCESS_BLOCKED || current->age == current->lifespan)
 	{
 		goto pick_next;
 	}
 
-	if (current->age < current->lifespan)
-	{
-		if (!list_empty(&readyqueue))
-		{
-			struct process *tmp = NULL;
-			unsigned int min = UINT_MAX;
-
-			list_for_each_entry(tmp, &readyqueue, list)
-			{
-				if (tmp->lifespan - tmp->age < min)
-				{
-					min = tmp->lifespan;
-					next = tmp;
-				}
-			}
-			if (current->lifespan - current->age > min)
-			{
-				list_add_tail(&current->list, &readyqueue);
-			}
-			else
-			{
-				return current;
-			}
-			list_del_init(&next->list);
-		}
-		else
-		{
-			return current;
-		}
-	}
-	else if (current->age == current->lifespan)
+	/* The ready queue is indexed by the remaining time */
+	next = peek_ready();
+	if (next && current->lifespan - current->age > next->lifespan - next->age)
 	{
-		goto pick_next;
+		enqueue_ready(current);
+		dequeue_ready(next);
+		return next;
 	}
-
-	return next;
+	return current;
 
 pick_next:
-	if (!list_empty(&readyqueue))
+	next = peek_ready();
+	if (next)
 	{
-		struct process *tmp = NULL;
-		unsigned int min = UINT_MAX;
-
-		list_for_each_entry(tmp, &readyqueue, list)
-		{
-			if (tmp->lifespan - tmp->age < min)
-			{
-				min = tmp->lifespan - tmp->age;
-				next = tmp;
-			}
-		}
-		list_del_init(&next->list);
-	}
-	else if (!current && list_empty(&readyqueue))
-	{
-		return NULL;
+		dequeue_ready(next);
 	}
 	return next;
 }
 
 struct scheduler stcf_scheduler = {
 	.name = "Shortest Time-to-Complete First",
+	.quantum = UINT_MAX,
+	.rq = &remaining_heap_rq,
 	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
 	.release = fcfs_release, /* Use the default FCFS release() */
 	.schedule = stcf_schedule,
@@ -351,68 +290,102 @@ static struct process *rr_schedule(void)
 
 	if (current->age < current->lifespan)
 	{
-		list_add_tail(&current->list, &readyqueue);
+		enqueue_ready(current);
 	}
 
 pick_next:
-	if (!list_empty(&readyqueue))
+	next = peek_ready();
+	if (next)
 	{
-		next = list_first_entry(&readyqueue, struct process, list);
-		list_del_init(&next->list);
+		dequeue_ready(next);
 	}
 	return next;
 }
 
 struct scheduler rr_scheduler = {
 	.name = "Round-Robin",
+	.quantum = 1,
 	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
 	.release = fcfs_release, /* Use the default FCFS release() */
 	.schedule = rr_schedule,
 };
 
 /***********************************************************************
- * Priority scheduler
+ * Priority-ordered waitqueues
+ *
+ * The priority schedulers keep the waitqueue of a resource in the
+ * priority order, and the waiters of the same priority in the arrival
+ * order. So, the first waiter is the one to wake up on release. The owner
+ * lists the resource in @owning so that what it inherits from the waiters
+ * is found without visiting them.
  ***********************************************************************/
-static bool prio_acquire(int resource_id)
+static void __queue_waiter(struct resource *r, struct process *p)
 {
-	struct resource *r = resources + resource_id;
+	struct list_head *pos;
 
-	if (!r->owner)
+	/* Mostly appending as the waiters of the same priority come in order */
+	list_for_each_prev(pos, &r->waitqueue)
 	{
-		r->owner = current;
-		return true;
+		if (list_entry(pos, struct process, list)->prio >= p->prio)
+		{
+			break;
+		}
 	}
+	list_add(&p->list, pos);
+}
+
+static void __own_resource(struct resource *r)
+{
+	r->owner = current;
+	list_add_tail(&r->list, &current->owning);
+}
 
+static void __wait_for_resource(struct resource *r)
+{
 	current->status = PROCESS_BLOCKED;
-	list_add_tail(&current->list, &r->waitqueue);
-	return false;
+	current->waiting_for = r;
+	__queue_waiter(r, current);
 }
 
-static void prio_release(int resource_id)
+static void __disown_resource(struct resource *r)
 {
-	struct resource *r = resources + resource_id;
 	assert(r->owner == current);
+
 	r->owner = NULL;
+	list_del_init(&r->list);
 
 	if (!list_empty(&r->waitqueue))
 	{
-		struct process *tmp = NULL;
-		struct process *waiter = NULL;
-		waiter = list_first_entry(&r->waitqueue, struct process, list);
-
-		list_for_each_entry(tmp, &r->waitqueue, list)
-		{
-			if (tmp->prio > waiter->prio)
-			{
-				waiter = tmp;
-			}
-		}
+		struct process *waiter = list_first_entry(&r->waitqueue, struct process, list);
 
 		assert(waiter->status == PROCESS_BLOCKED);
 		list_del_init(&waiter->list);
 		waiter->status = PROCESS_READY;
-		list_add_tail(&waiter->list, &readyqueue);
+		waiter->waiting_for = NULL;
+		enqueue_ready(waiter);
+	}
+}
+
+/***********************************************************************
+ * Priority scheduler
+ ***********************************************************************/
+static bool prio_acquire(int resource_id)
+{
+	struct resource *r = resources + resource_id;
+
+	if (!r->owner)
+	{
+		__own_resource(r);
+		return true;
 	}
+
+	__wait_for_resource(r);
+	return false;
+}
+
+static void prio_release(int resource_id)
+{
+	__disown_resource(resources + resource_id);
 }
 
 static struct process *prio_schedule(void)
@@ -426,30 +399,26 @@ static struct process *prio_schedule(void)
 
 	if (current->age < current->lifespan)
 	{
-		list_add_tail(&current->list, &readyqueue);
+		enqueue_ready(current);
 	}
 
 pick_next:
-	if (!list_empty(&readyqueue))
+	/**
+	 * The priority array gives the highest priority one, which is the last
+	 * one queued among the same priority
+	 */
+	next = peek_ready();
+	if (next)
 	{
-		struct process *tmp = NULL;
-		unsigned int max = 0;
-
-		list_for_each_entry(tmp, &readyqueue, list)
-		{
-			if (tmp->prio >= max)
-			{
-				max = tmp->prio;
-				next = tmp;
-			}
-		}
-		list_del_init(&next->list);
+		dequeue_ready(next);
 	}
 	return next;
 }
 
 struct scheduler prio_scheduler = {
 	.name = "Priority",
+	.quantum = 1,
+	.rq = &prio_array_rq,
 	.acquire = prio_acquire,
 	.release = prio_release,
 	.schedule = prio_schedule,
@@ -460,7 +429,6 @@ struct scheduler prio_scheduler = {
  ***********************************************************************/
 static struct process *pa_schedule(void)
 {
-
 	struct process *next = NULL;
 
 	if (!current || current->status == PROCESS_BLOCKED)
@@ -470,33 +438,29 @@ static struct process *pa_schedule(void)
 
 	if (current->age < current->lifespan)
 	{
-		list_add_tail(&current->list, &readyqueue);
+		enqueue_ready(current);
 	}
 
 pick_next:
+	/**
+	 * Age all the ready processes, and pick the one of the highest priority.
+	 * The aging index does it without visiting every ready process.
+	 */
+	age_ready();
 
-	if (!list_empty(&readyqueue))
+	next = peek_ready();
+	if (next)
 	{
-		struct process *tmp = NULL;
-		unsigned int max = 0;
-
-		list_for_each_entry(tmp, &readyqueue, list)
-		{
-			tmp->prio++;
-			if (tmp->prio > max && tmp->prio < MAX_PRIO)
-			{
-				max = tmp->prio;
-				next = tmp;
-			}
-		}
+		dequeue_ready(next);
 		next->prio = next->prio_orig;
-		list_del_init(&next->list);
 	}
 	return next;
 }
 
 struct scheduler pa_scheduler = {
 	.name = "Priority + aging",
+	.quantum = 1,
+	.rq = &aging_rq,
 	.acquire = prio_acquire,
 	.release = prio_release,
 	.schedule = pa_schedule,
@@ -504,9 +468,9 @@ struct scheduler pa_scheduler = {
 
 /***********************************************************************
  * Priority scheduler with priority ceiling protocol
- * acquire/release 수정 필요
- * acquire할 때 priority max_prio까지 높이기
- * release할 때 원래 priority로 복귀 필요
+ *
+ * The owner of any resource runs at MAX_PRIO, and gets back to its
+ * original priority when it releases the last one.
  ***********************************************************************/
 static bool pcp_acquire(int resource_id)
 {
@@ -514,47 +478,29 @@ static bool pcp_acquire(int resource_id)
 
 	if (!r->owner)
 	{
-		r->owner = current;
-		r->owner->prio = MAX_PRIO;
+		__own_resource(r);
+		current->prio = MAX_PRIO;
 		return true;
 	}
 
-	current->status = PROCESS_BLOCKED;
-	list_add_tail(&current->list, &r->waitqueue);
+	__wait_for_resource(r);
 	return false;
 }
 
 static void pcp_release(int resource_id)
 {
-	struct resource *r = resources + resource_id;
-	assert(r->owner == current);
-
-	r->owner = NULL;
+	__disown_resource(resources + resource_id);
 
-	if (!list_empty(&r->waitqueue))
+	if (list_empty(&current->owning))
 	{
-		struct process *tmp = NULL;
-		struct process *waiter = NULL;
-		waiter = list_first_entry(&r->waitqueue, struct process, list);
-
-		list_for_each_entry(tmp, &r->waitqueue, list)
-		{
-			if (tmp->prio > waiter->prio)
-			{
-				waiter = tmp;
-				waiter->prio = waiter->prio_orig;
-			}
-		}
-
-		assert(waiter->status == PROCESS_BLOCKED);
-		list_del_init(&waiter->list);
-		waiter->status = PROCESS_READY;
-		list_add_tail(&waiter->list, &readyqueue);
+		current->prio = current->prio_orig;
 	}
 }
 
 struct scheduler pcp_scheduler = {
 	.name = "Priority + PCP Protocol",
+	.quantum = 1,
+	.rq = &prio_array_rq,
 	.acquire = pcp_acquire,
 	.release = pcp_release,
 	.schedule = prio_schedule,
@@ -562,58 +508,85 @@ struct scheduler pcp_scheduler = {
 
 /***********************************************************************
  * Priority scheduler with priority inheritance protocol
+ *
+ * The owner runs at the highest priority among its own and the first
+ * waiters of the resources it owns. When the priority of a waiter changes,
+ * the change goes down the chain of the owners of what they are waiting
+ * for, and stops at a process whose priority stays the same.
  ***********************************************************************/
-static bool pip_acquire(int resource_id)
+static unsigned int __inherited_prio(struct process *p)
 {
-	struct resource *r = resources + resource_id;
+	unsigned int prio = p->prio_orig;
+	struct resource *r;
 
-	if (!r->owner)
+	list_for_each_entry(r, &p->owning, list)
 	{
-		r->owner = current;
-		return true;
-	}
+		struct process *waiter;
 
-	current->status = PROCESS_BLOCKED;
+		if (list_empty(&r->waitqueue))
+		{
+			continue;
+		}
 
-	if (current->prio > r->owner->prio)
-	{
-		r->owner->prio = current->prio;
+		waiter = list_first_entry(&r->waitqueue, struct process, list);
+		if (waiter->prio > prio)
+		{
+			prio = waiter->prio;
+		}
 	}
-
-	list_add_tail(&current->list, &r->waitqueue);
-	return false;
+	return prio;
 }
 
-static void pip_release(int resource_id)
+static void __inherit_prio(struct process *p)
 {
-	struct resource *r = resources + resource_id;
-	assert(r->owner == current);
-	r->owner = NULL;
+	unsigned int prio;
 
-	if (!list_empty(&r->waitqueue))
+	while (p && (prio = __inherited_prio(p)) != p->prio)
 	{
-		struct process *tmp = NULL;
-		struct process *waiter = NULL;
-		waiter = list_first_entry(&r->waitqueue, struct process, list);
+		p->prio = prio;
 
-		list_for_each_entry(tmp, &r->waitqueue, list)
+		if (p->status == PROCESS_READY)
+		{
+			update_ready(p);
+			break;
+		}
+		if (p->status != PROCESS_BLOCKED)
 		{
-			if (tmp->prio > waiter->prio)
-			{
-				waiter = tmp;
-				waiter->prio = waiter->prio_orig;
-			}
+			break;
 		}
 
-		assert(waiter->status == PROCESS_BLOCKED);
-		list_del_init(&waiter->list);
-		waiter->status = PROCESS_READY;
-		list_add_tail(&waiter->list, &readyqueue);
+		/* Re-sort the waitqueue, and pass it on to the owner */
+		list_del_init(&p->list);
+		__queue_waiter(p->waiting_for, p);
+		p = p->waiting_for->owner;
+	}
+}
+
+static bool pip_acquire(int resource_id)
+{
+	struct resource *r = resources + resource_id;
+
+	if (!r->owner)
+	{
+		__own_resource(r);
+		return true;
 	}
+
+	__wait_for_resource(r);
+	__inherit_prio(r->owner);
+	return false;
+}
+
+static void pip_release(int resource_id)
+{
+	__disown_resource(resources + resource_id);
+	__inherit_prio(current);
 }
 
 struct scheduler pip_scheduler = {
 	.name = "Priority + PIP Protocol",
+	.quantum = 1,
+	.rq = &prio_array_rq,
 	.acquire = pip_acquire,
 	.release = pip_release,
 	.schedule = prio_schedule,
@@ -0,0 +1,62 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "pool.h"
+
+/**
+ * Objects follow the header of each chunk
+ */
+struct pool_chunk {
+	struct pool_chunk *next;
+	size_t __align;		/* Keep the objects aligned as malloc() does */
+};
+
+void init_pool(struct pool *pool, size_t size, unsigned int nr_per_chunk)
+{
+	pool->size = size;
+	pool->nr_per_chunk = nr_per_chunk;
+	pool->nr_used = nr_per_chunk;
+	pool->chunks = NULL;
+}
+
+void *pool_alloc(struct pool *pool)
+{
+	if (pool->nr_used == pool->nr_per_chunk) {
+		struct pool_chunk *chunk =
+			calloc(1, sizeof(*chunk) + pool->size * pool->nr_per_chunk);
+
+		assert(chunk && "Out of memory for the pool");
+		chunk->next = pool->chunks;
+		pool->chunks = chunk;
+		pool->nr_used = 0;
+	}
+
+	return (char *)(pool->chunks + 1) + pool->size * pool->nr_used++;
+}
+
+void destroy_pool(struct pool *pool)
+{
+	while (pool->chunks) {
+		struct pool_chunk *chunk = pool->chunks;
+
+		pool->chunks = chunk->next;
+		free(chunk);
+	}
+	pool->nr_used = pool->nr_per_chunk;
+}
@@ -0,0 +1,43 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stddef.h>
+
+/***********************************************************************
+ * Object pool
+ *
+ * DESCRIPTION
+ *   Hands out zeroed objects of @size bytes, packed in chunks of
+ *   @nr_per_chunk of them, in the allocating order. Objects are not freed
+ *   one by one; destroy_pool() frees them all at once.
+ */
+struct pool_chunk;
+
+struct pool {
+	size_t size;
+	unsigned int nr_per_chunk;
+	unsigned int nr_used;		/* # of objects handed out from @chunks */
+	struct pool_chunk *chunks;	/* The chunk being used, and the older ones */
+};
+
+void init_pool(struct pool *pool, size_t size, unsigned int nr_per_chunk);
+void *pool_alloc(struct pool *pool);
+void destroy_pool(struct pool *pool);
+
+#endif
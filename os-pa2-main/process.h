@@ -16,7 +16,13 @@
 #ifndef __PROCESS_H__
 #define __PROCESS_H__
 
+#include "rbtree.h"
+#include "heap.h"
+
 struct list_head;
+struct cpu;
+struct resource;
+struct resource_schedule;
 
 enum process_status {
 	PROCESS_READY,		/* Process is ready to run */
@@ -45,15 +51,38 @@ struct process {
 							   need it to implement dynamic priority features
 							   such as aging, PIP and PCP. */
 
+	struct list_head owning;	/* Resources the process owns, listed by
+								   struct resource.list */
+	struct resource *waiting_for;
+							/* The resource the process is waiting for, or NULL */
+
 
 	/** DO NOT ACCESS FOLLOWING VARIABLES. THESE ARE USED FOR SIMULATOR IMPLEMENTATION **/
 	unsigned int __starts_at;	/* When to fork the process */
+	struct rb_node __fork_node;	/* In the fork queue by @__starts_at */
+
+	struct cpu *__cpu;			/* CPU whose ready queue has the process */
+	unsigned long __rq_seq;		/* Order in @readyqueue; increases on enqueue */
+	unsigned int __rq_pos;		/* Priority list in the index */
+	struct heap_node __rq_node;	/* Heap slot in the index */
+	long __rq_key;				/* Sort key of the aging index */
+	struct list_head __rq_list;	/* List head for the priority array index */
+
+	unsigned int __blocked_at;	/* When blocked, or UINT_MAX if not blocked */
+	unsigned int __blocked_ticks;
+								/* # of ticks waited for resources so far */
+	unsigned int __blocked_on;	/* Resource the process is blocked on */
+	unsigned int __first_run;	/* When first scheduled, or UINT_MAX if not yet */
+	unsigned int __nr_switches;	/* # of times scheduled in */
 
 	struct list_head __resources_to_acquire;
 								/* Schedule to acquire resources */
 
-	struct list_head __resources_holding;
-								/* Resources that the process is currently holding */
+	struct resource_schedule **__holding;
+								/* Resources that the process is currently holding,
+								 * in a min-heap by the age to release them */
+	unsigned int __nr_holding;
+	unsigned int __holding_slots;
 };
 
 /**
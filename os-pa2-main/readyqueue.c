@@ -0,0 +1,356 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "list_head.h"
+#include "heap.h"
+
+#include "process.h"
+#include "sched.h"
+
+/**
+ * Per-CPU state of the indexes. Each index uses its own part of it
+ */
+#define BITS_PER_LONG		(sizeof(unsigned long) * CHAR_BIT)
+#define NR_PRIO_LEVELS		(MAX_PRIO + 1)
+#define PRIO_BITMAP_LONGS	((NR_PRIO_LEVELS + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+struct rq_index {
+	/* Priority array */
+	struct list_head prio_queues[NR_PRIO_LEVELS];
+	unsigned long prio_bitmap[PRIO_BITMAP_LONGS];
+
+	/* Shortest-job heaps and the aging queue */
+	struct min_heap heap;
+	struct min_heap saturated;
+	long aging_epoch;
+};
+
+static struct rq_index *__create_index(void)
+{
+	struct rq_index *rq = calloc(1, sizeof(*rq));
+
+	assert(rq && "Out of memory for the ready queue");
+	return rq;
+}
+
+/***********************************************************************
+ * Priority array
+ *
+ * Each priority level has a list of processes in the enqueueing order, and
+ * a bitmap tells which levels are not empty. @__rq_pos holds the level the
+ * process is listed in, which may differ from @prio until update_ready().
+ */
+static struct rq_index *prio_array_create(void)
+{
+	struct rq_index *rq = __create_index();
+
+	for (int i = 0; i < NR_PRIO_LEVELS; i++) {
+		INIT_LIST_HEAD(rq->prio_queues + i);
+	}
+	return rq;
+}
+
+static void prio_array_enqueue(struct rq_index *rq, struct process *p)
+{
+	struct list_head *queue;
+	struct list_head *pos;
+
+	assert(p->prio <= MAX_PRIO);
+
+	p->__rq_pos = p->prio;
+	queue = rq->prio_queues + p->__rq_pos;
+
+	/* Keep the level in the enqueueing order. Mostly appending */
+	list_for_each_prev(pos, queue) {
+		if (list_entry(pos, struct process, __rq_list)->__rq_seq < p->__rq_seq)
+			break;
+	}
+	list_add(&p->__rq_list, pos);
+
+	rq->prio_bitmap[p->__rq_pos / BITS_PER_LONG] |= 1UL << (p->__rq_pos % BITS_PER_LONG);
+}
+
+static void prio_array_dequeue(struct rq_index *rq, struct process *p)
+{
+	unsigned int level = p->__rq_pos;
+
+	list_del_init(&p->__rq_list);
+
+	if (list_empty(rq->prio_queues + level))
+		rq->prio_bitmap[level / BITS_PER_LONG] &= ~(1UL << (level % BITS_PER_LONG));
+}
+
+static void prio_array_update(struct rq_index *rq, struct process *p)
+{
+	if (p->__rq_pos == p->prio)
+		return;
+
+	prio_array_dequeue(rq, p);
+	prio_array_enqueue(rq, p);
+}
+
+static struct process *prio_array_peek(struct rq_index *rq)
+{
+	for (int i = PRIO_BITMAP_LONGS - 1; i >= 0; i--) {
+		unsigned int level;
+
+		if (!rq->prio_bitmap[i])
+			continue;
+
+		level = i * BITS_PER_LONG + BITS_PER_LONG - 1 - __builtin_clzl(rq->prio_bitmap[i]);
+		return list_last_entry(rq->prio_queues + level, struct process, __rq_list);
+	}
+	return NULL;
+}
+
+static void prio_array_destroy(struct rq_index *rq)
+{
+	free(rq);
+}
+
+const struct rq_ops prio_array_rq = {
+	.create = prio_array_create,
+	.destroy = prio_array_destroy,
+	.enqueue = prio_array_enqueue,
+	.dequeue = prio_array_dequeue,
+	.update = prio_array_update,
+	.peek = prio_array_peek,
+};
+
+
+/***********************************************************************
+ * Binary heaps
+ *
+ * The processes are kept in min-heaps of heap.h ordered by @less, so that
+ * the first one is the head of the heap. @__rq_node holds the slot of each
+ * process so that any of them can be taken out in O(log n).
+ */
+#define __heap_process(node) heap_entry(node, struct process, __rq_node)
+
+static void __heap_push(struct min_heap *h, struct process *p)
+{
+	bool pushed = min_heap_push(h, &p->__rq_node);
+
+	assert(pushed && "Out of memory for the ready queue");
+}
+
+static struct process *__heap_first(struct min_heap *h)
+{
+	return heap_entry_safe(min_heap_peek(h), struct process, __rq_node);
+}
+
+static bool __earlier(const struct heap_node *a, const struct heap_node *b)
+{
+	return __heap_process(a)->__rq_seq < __heap_process(b)->__rq_seq;
+}
+
+
+/***********************************************************************
+ * Shortest-job heaps
+ */
+static bool __shorter_lifespan(const struct heap_node *a, const struct heap_node *b)
+{
+	struct process *pa = __heap_process(a);
+	struct process *pb = __heap_process(b);
+
+	if (pa->lifespan != pb->lifespan)
+		return pa->lifespan < pb->lifespan;
+	return __earlier(a, b);
+}
+
+static bool __shorter_remaining(const struct heap_node *a, const struct heap_node *b)
+{
+	struct process *pa = __heap_process(a);
+	struct process *pb = __heap_process(b);
+	unsigned int ra = pa->lifespan - pa->age;
+	unsigned int rb = pb->lifespan - pb->age;
+
+	if (ra != rb)
+		return ra < rb;
+	return __earlier(a, b);
+}
+
+static struct rq_index *lifespan_heap_create(void)
+{
+	struct rq_index *rq = __create_index();
+
+	min_heap_init(&rq->heap, __shorter_lifespan);
+	return rq;
+}
+
+static struct rq_index *remaining_heap_create(void)
+{
+	struct rq_index *rq = __create_index();
+
+	min_heap_init(&rq->heap, __shorter_remaining);
+	return rq;
+}
+
+static void job_heap_destroy(struct rq_index *rq)
+{
+	min_heap_free(&rq->heap);
+	free(rq);
+}
+
+static void job_heap_enqueue(struct rq_index *rq, struct process *p)
+{
+	__heap_push(&rq->heap, p);
+}
+
+static void job_heap_dequeue(struct rq_index *rq, struct process *p)
+{
+	min_heap_remove(&rq->heap, &p->__rq_node);
+}
+
+static void job_heap_update(struct rq_index *rq, struct process *p)
+{
+	min_heap_fix(&rq->heap, &p->__rq_node);
+}
+
+static struct process *job_heap_peek(struct rq_index *rq)
+{
+	return __heap_first(&rq->heap);
+}
+
+const struct rq_ops lifespan_heap_rq = {
+	.create = lifespan_heap_create,
+	.destroy = job_heap_destroy,
+	.enqueue = job_heap_enqueue,
+	.dequeue = job_heap_dequeue,
+	.update = job_heap_update,
+	.peek = job_heap_peek,
+};
+
+const struct rq_ops remaining_heap_rq = {
+	.create = remaining_heap_create,
+	.destroy = job_heap_destroy,
+	.enqueue = job_heap_enqueue,
+	.dequeue = job_heap_dequeue,
+	.update = job_heap_update,
+	.peek = job_heap_peek,
+};
+
+
+/***********************************************************************
+ * Aging priority queue
+ *
+ * Every age() boosts the priority of all ready processes by one, up to
+ * MAX_PRIO. Rather than touching each of them, the queue counts the boosts
+ * in @aging_epoch and keeps @__rq_key = @prio - (@aging_epoch at the
+ * enqueue), so that the effective priority is @__rq_key + @aging_epoch.
+ * The order by @__rq_key never changes on aging, and only a heap is needed.
+ *
+ * Processes reaching MAX_PRIO are all equal from then on. They are moved
+ * to a second heap ordered by the enqueueing order, each just once.
+ * @prio is brought up to date when the process leaves the queue.
+ */
+static bool __higher_aged_prio(const struct heap_node *a, const struct heap_node *b)
+{
+	struct process *pa = __heap_process(a);
+	struct process *pb = __heap_process(b);
+
+	if (pa->__rq_key != pb->__rq_key)
+		return pa->__rq_key > pb->__rq_key;
+	return __earlier(a, b);
+}
+
+static bool __saturated(struct rq_index *rq, struct process *p)
+{
+	return p->__rq_key + rq->aging_epoch >= MAX_PRIO;
+}
+
+static struct rq_index *aging_create(void)
+{
+	struct rq_index *rq = __create_index();
+
+	min_heap_init(&rq->heap, __higher_aged_prio);
+	min_heap_init(&rq->saturated, __earlier);
+	return rq;
+}
+
+static void aging_destroy(struct rq_index *rq)
+{
+	min_heap_free(&rq->heap);
+	min_heap_free(&rq->saturated);
+	free(rq);
+}
+
+static void aging_enqueue(struct rq_index *rq, struct process *p)
+{
+	p->__rq_key = (long)p->prio - rq->aging_epoch;
+
+	if (__saturated(rq, p)) {
+		__heap_push(&rq->saturated, p);
+	} else {
+		__heap_push(&rq->heap, p);
+	}
+}
+
+static void aging_dequeue(struct rq_index *rq, struct process *p)
+{
+	if (__saturated(rq, p)) {
+		p->prio = MAX_PRIO;
+	} else {
+		p->prio = p->__rq_key + rq->aging_epoch;
+	}
+
+	/* Each slot holds exactly one process; see which heap has @p */
+	if (min_heap_contains(&rq->saturated, &p->__rq_node)) {
+		min_heap_remove(&rq->saturated, &p->__rq_node);
+	} else {
+		min_heap_remove(&rq->heap, &p->__rq_node);
+	}
+}
+
+static void aging_update(struct rq_index *rq, struct process *p)
+{
+	aging_dequeue(rq, p);
+	aging_enqueue(rq, p);
+}
+
+static void aging_age(struct rq_index *rq)
+{
+	struct process *p;
+
+	rq->aging_epoch++;
+
+	while ((p = __heap_first(&rq->heap)) && __saturated(rq, p)) {
+		min_heap_remove(&rq->heap, &p->__rq_node);
+		__heap_push(&rq->saturated, p);
+	}
+}
+
+static struct process *aging_peek(struct rq_index *rq)
+{
+	struct process *p = __heap_first(&rq->saturated);
+
+	return p ? p : __heap_first(&rq->heap);
+}
+
+const struct rq_ops aging_rq = {
+	.create = aging_create,
+	.destroy = aging_destroy,
+	.enqueue = aging_enqueue,
+	.dequeue = aging_dequeue,
+	.update = aging_update,
+	.age = aging_age,
+	.peek = aging_peek,
+};
@@ -31,15 +31,22 @@ struct resource {
 	struct process *owner;
 
 	/**
-	 * list head to list processes that are wanting for the resource
+	 * list head to list processes that are wanting for the resource.
+	 * The priority schedulers keep it in the priority order so that the
+	 * first one is the waiter of the highest priority
 	 */
 	struct list_head waitqueue;
+
+	/**
+	 * list head to list this resource in @owning of its owner
+	 */
+	struct list_head list;
 };
 
 /**
- * This system has 16 different resources. It is defined in sched.c as an array of
- * struct resource (i.e., struct resource resources[NR_RESOURCES];)
+ * The system has as many resources as the process script uses, that is, one
+ * more than the largest resource id in it. They are allocated as an array of
+ * struct resource, @resources[NR_RESOURCES], in sched.h
  */
-#define NR_RESOURCES 16
 
 #endif
@@ -0,0 +1,193 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "script.h"
+
+/**
+ * Convert a text process script into the binary format that sched loads
+ * without parsing. The script is checked for the syntax only; the values
+ * are checked by sched as for the text script.
+ */
+static const char *__filename;
+static FILE *__out;
+static struct script_header __header;
+
+static bool __write(const void *data, size_t size)
+{
+	if (fwrite(data, size, 1, __out) != 1) {
+		fprintf(stderr, "Unable to write the binary script\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * The acquisitions of a process are held until its end, when the number of
+ * them is known
+ */
+static struct script_acquire *__acquires = NULL;
+static unsigned int __nr_acquires = 0;
+static unsigned int __acquire_slots = 0;
+
+static bool __queue_acquire(int args[])
+{
+	if (__nr_acquires == __acquire_slots) {
+		unsigned int nr = __acquire_slots ? __acquire_slots * 2 : 16;
+		struct script_acquire *acquires = realloc(__acquires, sizeof(*acquires) * nr);
+
+		if (!acquires) {
+			fprintf(stderr, "Out of memory\n");
+			return false;
+		}
+		__acquires = acquires;
+		__acquire_slots = nr;
+	}
+
+	__acquires[__nr_acquires++] = (struct script_acquire) {
+		.resource_id = args[0],
+		.at = args[1],
+		.duration = args[2],
+	};
+	return true;
+}
+
+static bool __compile(const char *script, size_t size)
+{
+	struct script_scanner scanner;
+	struct script_process process;
+	bool in_process = false;
+	enum script_item item;
+	int args[SCRIPT_MAX_ARGS];
+
+	init_script_scanner(&scanner, script, size);
+
+	while ((item = script_scan(&scanner, args)) != SCRIPT_EOF) {
+		if (item == SCRIPT_UNKNOWN) {
+			fprintf(stderr, "Unknown property %.*s\n", scanner.word_len, scanner.word);
+			return false;
+		} else if (item == SCRIPT_INVALID) {
+			fprintf(stderr, "Invalid line %u in %s\n", scanner.line, __filename);
+			return false;
+		} else if (item == SCRIPT_PROCESS) {
+			/* Processes left without end are dropped as sched does */
+			process = (struct script_process) {
+				.pid = args[0],
+			};
+			__nr_acquires = 0;
+			in_process = true;
+			continue;
+		}
+
+		if (!in_process) {
+			fprintf(stderr, "Line %u in %s is not in a process\n", scanner.line, __filename);
+			return false;
+		}
+
+		switch (item) {
+		case SCRIPT_END:
+			process.nr_acquires = __nr_acquires;
+			if (!__write(&process, sizeof(process)) ||
+					(__nr_acquires && !__write(__acquires, sizeof(*__acquires) * __nr_acquires)))
+				return false;
+
+			__header.nr_processes++;
+			__header.nr_acquires += __nr_acquires;
+			in_process = false;
+			break;
+		case SCRIPT_LIFESPAN:
+			process.lifespan = args[0];
+			break;
+		case SCRIPT_PRIO:
+			process.prio = args[0];
+			break;
+		case SCRIPT_START:
+			process.starts_at = args[0];
+			break;
+		case SCRIPT_ACQUIRE:
+			if (!__queue_acquire(args))
+				return false;
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+static void __print_usage(char *const name)
+{
+	printf("Usage: %s [text script] [binary script]\n", name);
+	printf("\n");
+	printf("Compile the text process script into the binary script, which sched\n");
+	printf("takes in place of the text one and loads without parsing.\n");
+	printf("\n");
+}
+
+int main(int argc, char *const argv[])
+{
+	const char *script;
+	size_t size;
+	bool ok;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "h")) != -1) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (argc - optind != 2) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	__filename = argv[optind];
+	script = map_script(__filename, &size);
+	if (!script) {
+		fprintf(stderr, "Unable to open %s\n", __filename);
+		return EXIT_FAILURE;
+	}
+
+	__out = fopen(argv[optind + 1], "wb");
+	if (!__out) {
+		fprintf(stderr, "Unable to open %s\n", argv[optind + 1]);
+		return EXIT_FAILURE;
+	}
+
+	/* The header is written again with the numbers at the end */
+	memcpy(__header.magic, SCRIPT_MAGIC, sizeof(__header.magic));
+	__header.version = SCRIPT_VERSION;
+
+	ok = __write(&__header, sizeof(__header)) && __compile(script, size);
+	if (ok) {
+		ok = !fseek(__out, 0, SEEK_SET) && __write(&__header, sizeof(__header));
+	}
+
+	if (fclose(__out) || !ok) {
+		remove(argv[optind + 1]);
+		ok = false;
+	}
+	unmap_script(script, size);
+	free(__acquires);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,299 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+/**
+ * Render the binary trace of sched -o as the text trace of sched, or as a
+ * Chrome trace (chrome://tracing, https://ui.perfetto.dev). A tick is shown
+ * as a millisecond in the latter.
+ */
+static const struct trace_header *__header;
+static const struct trace_event *__events;
+static size_t __nr_events;
+
+static bool __map_trace(const char *filename)
+{
+	struct stat st;
+	void *trace;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "Unable to open %s\n", filename);
+		return false;
+	}
+
+	if (st.st_size < (off_t)sizeof(*__header) ||
+			(st.st_size - sizeof(*__header)) % sizeof(*__events)) {
+		fprintf(stderr, "%s is not a trace\n", filename);
+		close(fd);
+		return false;
+	}
+
+	trace = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (trace == MAP_FAILED) {
+		fprintf(stderr, "Unable to map %s\n", filename);
+		return false;
+	}
+
+	__header = trace;
+	if (memcmp(__header->magic, TRACE_MAGIC, sizeof(__header->magic)) ||
+			__header->version != TRACE_VERSION) {
+		fprintf(stderr, "%s is not a trace of this version\n", filename);
+		return false;
+	}
+
+	__events = (const struct trace_event *)(__header + 1);
+	__nr_events = (st.st_size - sizeof(*__header)) / sizeof(*__events);
+	return true;
+}
+
+static bool __is_span(const struct trace_event *e)
+{
+	return e->type == TRACE_RUN || e->type == TRACE_IDLE;
+}
+
+/***********************************************************************
+ * Text trace
+ */
+static void __render_text(void)
+{
+	size_t i = 0;
+
+	while (i < __nr_events) {
+		const struct trace_event *e = __events + i;
+		size_t end = i + 1;
+
+		/* The CPUs take turns in each tick of the spans starting together */
+		if (__is_span(e)) {
+			while (end < __nr_events && __is_span(__events + end) &&
+					__events[end].tick == e->tick &&
+					__events[end].nr_ticks == e->nr_ticks)
+				end++;
+		}
+
+		for (unsigned int t = 0; t < e->nr_ticks; t++) {
+			for (size_t j = i; j < end; j++) {
+				print_trace_event(stdout, __events + j, e->tick + t, __header->nr_processors);
+			}
+		}
+		i = end;
+	}
+}
+
+/***********************************************************************
+ * Chrome trace
+ *
+ * The CPUs are the threads of "process" 0, and the resources are the
+ * threads of "process" 1. The consecutive ticks a process runs on a CPU
+ * make a slice, and so do the ticks from acquiring a resource to
+ * releasing it.
+ */
+struct slice {
+	bool open;
+	unsigned int pid;
+	unsigned int start;
+	unsigned int end;
+};
+
+static const char *__delim = "";
+
+static unsigned long __usecs(unsigned int ticks)
+{
+	return ticks * 1000UL;
+}
+
+#define __emit(format, args...)                  \
+	do {                                         \
+		printf("%s\n    " format, __delim, ##args); \
+		__delim = ",";                            \
+	} while (0)
+
+static void __emit_slice(unsigned int group, unsigned int track, struct slice *s)
+{
+	if (!s->open)
+		return;
+
+	__emit("{ \"name\": \"%u\", \"ph\": \"X\", \"pid\": %u, \"tid\": %u, "
+	       "\"ts\": %lu, \"dur\": %lu }", s->pid, group, track,
+	       __usecs(s->start), __usecs(s->end - s->start));
+	s->open = false;
+}
+
+static void __emit_instant(const struct trace_event *e, const char *what)
+{
+	__emit("{ \"name\": \"%u %s\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 0, "
+	       "\"tid\": %u, \"ts\": %lu }", e->pid, what, e->cpu, __usecs(e->tick));
+}
+
+static void __render_chrome(void)
+{
+	struct slice *runs = calloc(__header->nr_processors, sizeof(*runs));
+	struct slice *holds = NULL;
+	unsigned int nr_resources = 0;
+	char what[32];
+
+	if (!runs)
+		exit(EXIT_FAILURE);
+
+	/* Resource ids are not known in advance */
+	for (size_t i = 0; i < __nr_events; i++) {
+		if (__events[i].type == TRACE_ACQUIRE && __events[i].resource_id >= nr_resources)
+			nr_resources = __events[i].resource_id + 1;
+	}
+	if (nr_resources) {
+		holds = calloc(nr_resources, sizeof(*holds));
+		if (!holds)
+			exit(EXIT_FAILURE);
+	}
+
+	printf("{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [");
+
+	__emit("{ \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, "
+	       "\"args\": { \"name\": \"%.*s\" } }",
+	       (int)sizeof(__header->scheduler), __header->scheduler);
+	for (unsigned int cpu = 0; cpu < __header->nr_processors; cpu++) {
+		__emit("{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, "
+		       "\"args\": { \"name\": \"CPU %u\" } }", cpu, cpu);
+	}
+	__emit("{ \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+	       "\"args\": { \"name\": \"Resources\" } }");
+	for (unsigned int r = 0; r < nr_resources; r++) {
+		__emit("{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+		       "\"args\": { \"name\": \"Resource %u\" } }", r, r);
+	}
+
+	for (size_t i = 0; i < __nr_events; i++) {
+		const struct trace_event *e = __events + i;
+		struct slice *run = runs + e->cpu;
+		struct slice *hold;
+
+		switch (e->type) {
+		case TRACE_RUN:
+			if (run->open && run->pid == e->pid && run->end == e->tick) {
+				run->end += e->nr_ticks;
+				break;
+			}
+			__emit_slice(0, e->cpu, run);
+			*run = (struct slice) {
+				.open = true,
+				.pid = e->pid,
+				.start = e->tick,
+				.end = e->tick + e->nr_ticks,
+			};
+			break;
+		case TRACE_IDLE:
+			__emit_slice(0, e->cpu, run);
+			break;
+		case TRACE_FORK:
+			__emit_instant(e, "forked");
+			break;
+		case TRACE_EXIT:
+			__emit_instant(e, "exited");
+			break;
+		case TRACE_BLOCK:
+			snprintf(what, sizeof(what), "blocked on %u", e->resource_id);
+			__emit_instant(e, what);
+			break;
+		case TRACE_ACQUIRE:
+			hold = holds + e->resource_id;
+			*hold = (struct slice) {
+				.open = true,
+				.pid = e->pid,
+				.start = e->tick,
+			};
+			break;
+		case TRACE_RELEASE:
+			/* Released at the end of the tick */
+			if (e->resource_id < nr_resources) {
+				hold = holds + e->resource_id;
+				hold->end = e->tick + 1;
+				__emit_slice(1, e->resource_id, hold);
+			}
+			break;
+		}
+	}
+
+	for (unsigned int cpu = 0; cpu < __header->nr_processors; cpu++) {
+		__emit_slice(0, cpu, runs + cpu);
+	}
+
+	printf("\n  ]\n}\n");
+
+	free(runs);
+	free(holds);
+}
+
+static void __print_usage(char *const name)
+{
+	printf("Usage: %s {-f FORMAT} [trace file]\n", name);
+	printf("\n");
+	printf("  -f: Render the trace written by sched -o in FORMAT, which is\n");
+	printf("      text  : The trace sched prints to stderr (default)\n");
+	printf("      chrome: Chrome trace JSON for chrome://tracing or Perfetto\n");
+	printf("\n");
+}
+
+int main(int argc, char *const argv[])
+{
+	bool chrome = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (!strcmp(optarg, "chrome")) {
+				chrome = true;
+			} else if (strcmp(optarg, "text")) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+		default:
+			__print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!__map_trace(argv[optind])) {
+		return EXIT_FAILURE;
+	}
+
+	if (chrome) {
+		__render_chrome();
+	} else {
+		__render_text();
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -18,36 +18,30 @@
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
-#include <unistd.h>
-#include <getopt.h>
+#include <limits.h>
 
 #include "list_head.h"
 
-#include "parser.h"
 #include "process.h"
 #include "resource.h"
 
 #include "sched.h"
+#include "trace.h"
+#include "pool.h"
+#include "script.h"
 
 /**
- * List head to hold the processes ready to run
+ * The simulation of this thread. The processors in the system, each of which
+ * has the process that is currently running and the list head to hold the
+ * processes ready to run on it, the ticks since the simulator was started,
+ * and the resources in the system are all in there
  */
-LIST_HEAD(readyqueue);
+__thread struct simulation *sim = NULL;
 
-/**
- * The process that is currently running
- */
-struct process *current = NULL;
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
 
-/**
- * Number of generated ticks since the simulator was started
- */
-unsigned int ticks = 0;
-
-/**
- * Resources in the system.
- */
-struct resource resources[NR_RESOURCES];
+#define for_each_cpu(cpu) \
+	for (struct cpu *cpu = cpus; cpu < cpus + nr_cpus; cpu++)
 
 /**
  * Following code is to maintain the simulator itself.
@@ -56,12 +50,43 @@ struct resource_schedule {
 	unsigned int resource_id;
 	unsigned int at;
 	unsigned int duration;
+	unsigned int acquired_at;
+	unsigned int releases_at;	/* Age at which to release the resource */
+	unsigned long seq;			/* Order of acquisition */
 	struct list_head list;
 };
 
-static LIST_HEAD(__forkqueue);
+/**
+ * Processes and resource schedules are allocated from pools while loading
+ * the script, that many in a chunk, and are freed at once at the end
+ */
+#define PROCESS_POOL_CHUNK	1024
+#define SCHEDULE_POOL_CHUNK	4096
+
+/**
+ * Processes to fork, sorted by @__starts_at. Processes starting at the same
+ * tick are kept in the order they appear in the script
+ */
+#define __forkqueue	(sim->forkqueue)
+
+/**
+ * Print the events of each tick to stderr. Cleared with -Q
+ */
+#define __trace		(sim->trace)
 
-bool quiet = false;
+/**
+ * Jump over the ticks in which nothing happens but idling or running the
+ * current process (-e). The trace is still printed tick by tick.
+ */
+#define __event_driven	(sim->event_driven)
+
+/**
+ * Load balancing among CPUs (-b). An idle CPU steals a ready process from
+ * the busiest CPU if @__steal, and every @__balance_interval ticks (unless
+ * 0) ready processes are moved over to even out the ready queues.
+ */
+#define __steal		(sim->steal)
+#define __balance_interval	(sim->balance_interval)
 
 static const char *__process_status_sz[] = {
 	"RDY",
@@ -82,27 +107,61 @@ extern struct scheduler pa_scheduler;
 extern struct scheduler pcp_scheduler;
 extern struct scheduler pip_scheduler;
 
-static struct scheduler *sched = &fcfs_scheduler;
+#define sched		(sim->sched)
+
+/**
+ * The schedulers by their option letter
+ */
+static const struct {
+	char opt;
+	struct scheduler *scheduler;
+} __schedulers[] = {
+	{ 'f', &fcfs_scheduler },
+	{ 's', &sjf_scheduler },
+	{ 'S', &stcf_scheduler },
+	{ 'r', &rr_scheduler },
+	{ 'p', &prio_scheduler },
+	{ 'a', &pa_scheduler },
+	{ 'c', &pcp_scheduler },
+	{ 'i', &pip_scheduler },
+	{ 0, NULL },
+};
+
+struct scheduler *lookup_scheduler(char opt)
+{
+	for (int i = 0; __schedulers[i].opt; i++) {
+		if (__schedulers[i].opt == opt)
+			return __schedulers[i].scheduler;
+	}
+	return NULL;
+}
+
+static void __dump_process(struct process *p)
+{
+	printf("%2d (%s): %d + %d/%d at %d\n", p->pid, __process_status_sz[p->status],
+	       p->__starts_at, p->age, p->lifespan, p->prio);
+}
 
 void dump_status(void)
 {
 	struct process *p;
 
-	printf("***** CURRENT *********\n");
-	if (current) {
-		printf("%2d (%s): %d + %d/%d at %d\n", current->pid,
-		       __process_status_sz[current->status], current->__starts_at, current->age,
-		       current->lifespan, current->prio);
-	}
+	for_each_cpu(cpu) {
+		if (nr_cpus > 1)
+			printf("***** CPU %-2u **********\n", cpu->id);
 
-	printf("***** READY QUEUE *****\n");
-	list_for_each_entry(p, &readyqueue, list) {
-		printf("%2d (%s): %d + %d/%d at %d\n", p->pid, __process_status_sz[p->status],
-		       p->__starts_at, p->age, p->lifespan, p->prio);
+		printf("***** CURRENT *********\n");
+		if (cpu->curr)
+			__dump_process(cpu->curr);
+
+		printf("***** READY QUEUE *****\n");
+		list_for_each_entry(p, &cpu->runqueue, list) {
+			__dump_process(p);
+		}
 	}
 
 	printf("***** RESOURCES *******\n");
-	for (int i = 0; i < NR_RESOURCES; i++) {
+	for (unsigned int i = 0; i < NR_RESOURCES; i++) {
 		struct resource *r = resources + i;
 
 		if (r->owner || !list_empty(&r->waitqueue)) {
@@ -123,16 +182,80 @@ void dump_status(void)
 	return;
 }
 
-#define __print_event(pid, string, args...)   \
-	do {                                      \
-		fprintf(stderr, "%3d: ", ticks);      \
-		for (unsigned int i = 0; i < pid; i++) {       \
-			fprintf(stderr, "    ");          \
-		}                                     \
-		fprintf(stderr, string "\n", ##args); \
-	} while (0);
+/**
+ * Trace an event on @this_cpu lasting @nr_ticks from now. It goes to the
+ * binary trace through a buffer with -o, or is printed to stderr
+ */
+#define TRACE_BUFFER_EVENTS	65536
+
+static void __flush_trace(void)
+{
+	fwrite(sim->trace_buffer, sizeof(*sim->trace_buffer), sim->nr_trace_buffered,
+	       sim->trace_file);
+	sim->nr_trace_buffered = 0;
+}
+
+static void __trace_ticks(enum trace_type type, unsigned int pid,
+			  unsigned int resource_id, unsigned int nr_ticks)
+{
+	struct trace_event event = {
+		.tick = ticks,
+		.pid = pid,
+		.nr_ticks = nr_ticks,
+		.resource_id = resource_id,
+		.cpu = this_cpu->id,
+		.type = type,
+	};
+
+	if (sim->trace_file) {
+		if (sim->nr_trace_buffered == TRACE_BUFFER_EVENTS)
+			__flush_trace();
+		sim->trace_buffer[sim->nr_trace_buffered++] = event;
+		return;
+	}
+
+	if (__trace)
+		print_trace_event(stderr, &event, ticks, nr_cpus);
+}
+
+#define __trace_event(type, pid, resource_id) \
+	__trace_ticks(type, pid, resource_id, 1)
+
+static bool __open_trace(const char *filename)
+{
+	struct trace_header header = {
+		.version = TRACE_VERSION,
+		.nr_processors = nr_cpus,
+	};
+
+	sim->trace_file = fopen(filename, "w");
+	if (!sim->trace_file) {
+		fprintf(stderr, "Unable to open %s\n", filename);
+		return false;
+	}
+
+	sim->trace_buffer = malloc(sizeof(*sim->trace_buffer) * TRACE_BUFFER_EVENTS);
+	assert(sim->trace_buffer && "Out of memory for the trace");
+
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	strncpy(header.scheduler, sched->name, sizeof(header.scheduler) - 1);
+	fwrite(&header, sizeof(header), 1, sim->trace_file);
+	return true;
+}
+
+static void __close_trace(void)
+{
+	if (!sim->trace_file)
+		return;
 
-static inline bool strmatch(char *const str, const char *expect)
+	__flush_trace();
+	fclose(sim->trace_file);
+	free(sim->trace_buffer);
+	sim->trace_file = NULL;
+	sim->trace_buffer = NULL;
+}
+
+static inline bool strmatch(const char *str, const char *expect)
 {
 	return (strlen(str) == strlen(expect)) && (strncmp(str, expect, strlen(expect)) == 0);
 }
@@ -153,97 +276,438 @@ static void __briefing_schedule(struct process *p)
 	}
 }
 
-static int __load_script(char *const filename)
+static bool __starts_earlier(struct rb_node *a, const struct rb_node *b)
 {
-	char line[MAX_COMMAND_LEN];
-	struct process *p = NULL;
+	return rb_entry(a, struct process, __fork_node)->__starts_at <
+			rb_entry(b, struct process, __fork_node)->__starts_at;
+}
 
-	FILE *file = fopen(filename, "r");
-	while (fgets(line, sizeof(line), file)) {
-		char *tokens[MAX_NR_TOKENS] = { NULL };
-		int nr_tokens = parse_command(line, tokens);
+static void __queue_fork(struct process *p)
+{
+	/* Ties go after the processes already queued */
+	rb_add_cached(&p->__fork_node, &__forkqueue, __starts_earlier);
+}
 
-		if (nr_tokens == 0)
-			continue;
+static struct process *__first_fork(void)
+{
+	return rb_entry_safe(rb_first_cached(&__forkqueue), struct process, __fork_node);
+}
 
-		if (strmatch(tokens[0], "process")) {
-			assert(nr_tokens == 2);
-			/* Start processor description */
-			p = malloc(sizeof(*p));
-			memset(p, 0x00, sizeof(*p));
+/**
+ * Sort the acquisitions of @p by @at so that only the first one is to be
+ * looked at. Those at the same age stay in the order in the script
+ */
+static void __sort_acquires(struct process *p)
+{
+	LIST_HEAD(sorted);
+
+	while (!list_empty(&p->__resources_to_acquire)) {
+		struct resource_schedule *rs =
+			list_first_entry(&p->__resources_to_acquire, struct resource_schedule, list);
+		struct list_head *pos;
+
+		list_for_each_prev(pos, &sorted) {
+			if (list_entry(pos, struct resource_schedule, list)->at <= rs->at)
+				break;
+		}
+		list_move(&rs->list, pos);
+	}
+	list_splice(&sorted, &p->__resources_to_acquire);
+}
+
+/**
+ * Processes from the script, in text or in binary
+ */
+static struct process *__create_process(int pid)
+{
+	struct process *p = pool_alloc(&sim->process_pool);
+
+	p->pid = pid;
+	p->__blocked_at = UINT_MAX;
+	p->__first_run = UINT_MAX;
+
+	INIT_LIST_HEAD(&p->list);
+	INIT_LIST_HEAD(&p->__rq_list);
+	INIT_LIST_HEAD(&p->__resources_to_acquire);
+	INIT_LIST_HEAD(&p->owning);
+
+	return p;
+}
+
+static bool __set_prio(struct process *p, int prio)
+{
+	p->prio = p->prio_orig = prio;
+	if (p->prio > MAX_PRIO) {
+		fprintf(stderr, "Priority %d is larger than %d\n", p->prio, MAX_PRIO);
+		return false;
+	}
+	return true;
+}
+
+static bool __add_acquire(struct process *p, int resource_id, int at, int duration)
+{
+	struct resource_schedule *rs;
+
+	if (resource_id < 0 || duration <= 0) {
+		fprintf(stderr, "Invalid resource schedule %d %d %d\n", resource_id, at, duration);
+		return false;
+	}
+
+	rs = pool_alloc(&sim->schedule_pool);
+
+	*rs = (struct resource_schedule) {
+		.resource_id = resource_id,
+		.at = at,
+		.duration = duration,
+	};
+
+	list_add_tail(&rs->list, &p->__resources_to_acquire);
+
+	/* The system has as many resources as the script uses */
+	if (rs->resource_id >= NR_RESOURCES)
+		NR_RESOURCES = rs->resource_id + 1;
+
+	return true;
+}
+
+static void __finish_process(struct process *p)
+{
+	__queue_fork(p);
 
-			p->pid = atoi(tokens[1]);
+	__briefing_schedule(p);
+	__sort_acquires(p);
+}
 
-			INIT_LIST_HEAD(&p->list);
-			INIT_LIST_HEAD(&p->__resources_to_acquire);
-			INIT_LIST_HEAD(&p->__resources_holding);
+static bool __load_text_script(const char *script, size_t size, const char *filename)
+{
+	struct script_scanner scanner;
+	struct process *p = NULL;
+	enum script_item item;
+	int args[SCRIPT_MAX_ARGS];
 
+	init_script_scanner(&scanner, script, size);
+
+	while ((item = script_scan(&scanner, args)) != SCRIPT_EOF) {
+		if (item == SCRIPT_UNKNOWN) {
+			fprintf(stderr, "Unknown property %.*s\n", scanner.word_len, scanner.word);
+			return false;
+		} else if (item == SCRIPT_INVALID) {
+			fprintf(stderr, "Invalid line %u in %s\n", scanner.line, filename);
+			return false;
+		} else if (item == SCRIPT_PROCESS) {
+			/* Start processor description */
+			p = __create_process(args[0]);
 			continue;
-		} else if (strmatch(tokens[0], "end")) {
-			/* End of process description */
-			assert(p);
+		}
 
-			list_add_tail(&p->list, &__forkqueue);
+		if (!p) {
+			fprintf(stderr, "Line %u in %s is not in a process\n", scanner.line, filename);
+			return false;
+		}
 
-			__briefing_schedule(p);
+		switch (item) {
+		case SCRIPT_END:
+			/* End of process description */
+			__finish_process(p);
 			p = NULL;
+			break;
+		case SCRIPT_LIFESPAN:
+			p->lifespan = args[0];
+			break;
+		case SCRIPT_PRIO:
+			if (!__set_prio(p, args[0]))
+				return false;
+			break;
+		case SCRIPT_START:
+			p->__starts_at = args[0];
+			break;
+		case SCRIPT_ACQUIRE:
+			if (!__add_acquire(p, args[0], args[1], args[2]))
+				return false;
+			break;
+		default:
+			assert(0 && "Unexpected script item");
+		}
+	}
+	return true;
+}
 
-			continue;
+/**
+ * The sizes in the header are checked against the file before anything is
+ * read, and the pools are sized to hold the whole script in single chunks
+ */
+static bool __load_binary_script(const char *script, size_t size, const char *filename)
+{
+	const struct script_header *header = (const struct script_header *)script;
+	const char *curr = script + sizeof(*header);
+	size_t rest;
+
+	if (header->version != SCRIPT_VERSION) {
+		fprintf(stderr, "%s is not a script of this version\n", filename);
+		return false;
+	}
+
+	if ((size - sizeof(*header)) / sizeof(struct script_process) < header->nr_processes) {
+		fprintf(stderr, "%s is truncated\n", filename);
+		return false;
+	}
+	rest = size - sizeof(*header) - header->nr_processes * sizeof(struct script_process);
+	if (rest % sizeof(struct script_acquire) ||
+			rest / sizeof(struct script_acquire) != header->nr_acquires) {
+		fprintf(stderr, "%s is truncated\n", filename);
+		return false;
+	}
+
+	if (header->nr_processes)
+		init_pool(&sim->process_pool, sizeof(struct process), header->nr_processes);
+	if (header->nr_acquires && header->nr_acquires <= UINT_MAX)
+		init_pool(&sim->schedule_pool, sizeof(struct resource_schedule), header->nr_acquires);
+
+	for (uint32_t i = 0; i < header->nr_processes; i++) {
+		const struct script_process *sp = (const struct script_process *)curr;
+		const struct script_acquire *sa = (const struct script_acquire *)(sp + 1);
+		struct process *p;
+
+		if ((size_t)(script + size - (const char *)sa) / sizeof(*sa) < sp->nr_acquires) {
+			fprintf(stderr, "%s is truncated\n", filename);
+			return false;
 		}
 
-		if (strmatch(tokens[0], "lifespan")) {
-			assert(nr_tokens == 2);
-			p->lifespan = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "prio")) {
-			assert(nr_tokens == 2);
-			p->prio = p->prio_orig = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "start")) {
-			assert(nr_tokens == 2);
-			p->__starts_at = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "acquire")) {
-			struct resource_schedule *rs;
-			assert(nr_tokens == 4);
-
-			rs = malloc(sizeof(*rs));
-
-			*rs = (struct resource_schedule) {
-				.resource_id = atoi(tokens[1]),
-				.at = atoi(tokens[2]),
-				.duration = atoi(tokens[3]),
-			};
-
-			list_add_tail(&rs->list, &p->__resources_to_acquire);
-		} else {
-			fprintf(stderr, "Unknown property %s\n", tokens[0]);
+		p = __create_process(sp->pid);
+		p->__starts_at = sp->starts_at;
+		p->lifespan = sp->lifespan;
+		if (!__set_prio(p, sp->prio))
 			return false;
+
+		for (uint32_t j = 0; j < sp->nr_acquires; j++, sa++) {
+			if (!__add_acquire(p, sa->resource_id, sa->at, sa->duration))
+				return false;
 		}
+
+		__finish_process(p);
+		curr = (const char *)sa;
 	}
-	fclose(file);
-	if (!quiet)
-		printf("\n");
 	return true;
 }
 
+static bool __load_script(const char *filename)
+{
+	const char *script;
+	size_t size;
+	bool ok;
+
+	script = map_script(filename, &size);
+	if (!script) {
+		fprintf(stderr, "Unable to open %s\n", filename);
+		return false;
+	}
+
+	if (size >= sizeof(struct script_header) &&
+			!memcmp(script, SCRIPT_MAGIC, sizeof(((struct script_header *)0)->magic))) {
+		ok = __load_binary_script(script, size, filename);
+	} else {
+		ok = __load_text_script(script, size, filename);
+	}
+	unmap_script(script, size);
+
+	if (ok && !quiet)
+		printf("\n");
+	return ok;
+}
+
+/**
+ * Ready queue operations which keep the index of the scheduler in sync
+ */
+void enqueue_ready(struct process *p)
+{
+	/* Being woken up */
+	if (p->__blocked_at != UINT_MAX) {
+		unsigned int blocked = ticks - p->__blocked_at + 1;
+
+		p->__blocked_ticks += blocked;
+		sim->stats.resource_stats[p->__blocked_on].contention += blocked;
+		p->__blocked_at = UINT_MAX;
+	}
+
+	p->__cpu = this_cpu;
+	p->__rq_seq = sim->rq_seq++;
+	list_add_tail(&p->list, &readyqueue);
+	this_cpu->nr_ready++;
+
+	if (sched->rq)
+		sched->rq->enqueue(this_cpu->__index, p);
+}
+
+void dequeue_ready(struct process *p)
+{
+	list_del_init(&p->list);
+	p->__cpu->nr_ready--;
+
+	if (sched->rq)
+		sched->rq->dequeue(p->__cpu->__index, p);
+}
+
+void update_ready(struct process *p)
+{
+	if (sched->rq)
+		sched->rq->update(p->__cpu->__index, p);
+}
+
+void age_ready(void)
+{
+	struct process *p;
+
+	if (sched->rq && sched->rq->age) {
+		sched->rq->age(this_cpu->__index);
+		return;
+	}
+
+	list_for_each_entry(p, &readyqueue, list) {
+		if (p->prio < MAX_PRIO)
+			p->prio++;
+	}
+}
+
+struct process *peek_ready(void)
+{
+	if (sched->rq)
+		return sched->rq->peek(this_cpu->__index);
+
+	if (list_empty(&readyqueue))
+		return NULL;
+	return list_first_entry(&readyqueue, struct process, list);
+}
+
+/**
+ * Load balancing
+ */
+static unsigned int __load(struct cpu *cpu)
+{
+	return cpu->nr_ready + (cpu->curr ? 1 : 0);
+}
+
+static struct cpu *__idlest_cpu(unsigned int (*load)(struct cpu *))
+{
+	struct cpu *idlest = cpus;
+
+	for_each_cpu(cpu) {
+		if (load(cpu) < load(idlest))
+			idlest = cpu;
+	}
+	return idlest;
+}
+
+static unsigned int __nr_ready(struct cpu *cpu)
+{
+	return cpu->nr_ready;
+}
+
+static struct cpu *__busiest_cpu(void)
+{
+	struct cpu *busiest = cpus;
+
+	for_each_cpu(cpu) {
+		if (cpu->nr_ready > busiest->nr_ready)
+			busiest = cpu;
+	}
+	return busiest;
+}
+
+/* Move the process @from would run next over to @this_cpu */
+static void __pull_ready(struct cpu *from)
+{
+	struct cpu *to = this_cpu;
+	struct process *p;
+
+	this_cpu = from;
+	p = peek_ready();
+	dequeue_ready(p);
+
+	this_cpu = to;
+	enqueue_ready(p);
+}
+
+/* Whether @this_cpu has nothing to run in this tick unless it steals */
+static bool __going_idle(void)
+{
+	if (!list_empty(&readyqueue))
+		return false;
+
+	return !current || current->status == PROCESS_BLOCKED ||
+		current->age == current->lifespan;
+}
+
+static void __balance_load(void)
+{
+	while (true) {
+		struct cpu *busiest = __busiest_cpu();
+
+		this_cpu = __idlest_cpu(__nr_ready);
+		if (busiest->nr_ready <= this_cpu->nr_ready + 1)
+			break;
+
+		__pull_ready(busiest);
+	}
+}
+
 /**
- * Fork process on schedule
+ * Fork process on schedule. It goes to the least loaded CPU
  */
 static int __fork_on_schedule()
 {
 	int nr_forked = 0;
-	struct process *p, *tmp;
-	list_for_each_entry_safe(p, tmp, &__forkqueue, list) {
-		if (p->__starts_at <= ticks) {
-			list_move_tail(&p->list, &readyqueue);
-			p->status = PROCESS_READY;
-			__print_event(p->pid, "N");
-			if (sched->forked)
-				sched->forked(p);
-			nr_forked++;
-		}
+
+	struct process *p;
+
+	while ((p = __first_fork())) {
+		if (p->__starts_at > ticks)
+			break;
+
+		this_cpu = __idlest_cpu(__load);
+
+		rb_erase_cached(&p->__fork_node, &__forkqueue);
+		enqueue_ready(p);
+		p->status = PROCESS_READY;
+		__trace_event(TRACE_FORK, p->pid, 0);
+		if (sched->forked)
+			sched->forked(p);
+		nr_forked++;
 	}
 	return nr_forked;
 }
 
+/**
+ * Account the process that is exiting
+ */
+static void __record_exit(struct process *p)
+{
+	struct sched_stats *stats = &sim->stats;
+	unsigned int turnaround = ticks - p->__starts_at;
+
+	if (stats->nr_exited == stats->nr_process_stats_slots) {
+		unsigned int nr = stats->nr_exited ? stats->nr_exited * 2 : 64;
+		struct process_stats *ps = realloc(stats->process_stats, sizeof(*ps) * nr);
+
+		assert(ps && "Out of memory for the statistics");
+		stats->process_stats = ps;
+		stats->nr_process_stats_slots = nr;
+	}
+
+	stats->process_stats[stats->nr_exited++] = (struct process_stats) {
+		.pid = p->pid,
+		.starts_at = p->__starts_at,
+		.first_run = p->__first_run,
+		.exits_at = ticks,
+		.lifespan = p->lifespan,
+		.blocked = p->__blocked_ticks,
+		.nr_switches = p->__nr_switches,
+	};
+
+	stats->turnaround += turnaround;
+	stats->blocked += p->__blocked_ticks;
+	stats->wait += turnaround - p->lifespan - p->__blocked_ticks;
+}
+
 /**
  * Exit the process
  */
@@ -253,7 +717,7 @@ static void __exit_process(struct process *p)
 	assert(list_empty(&p->list));
 
 	/* Make sure the process is not holding any resource */
-	assert(list_empty(&p->__resources_holding));
+	assert(!p->__nr_holding);
 
 	/* Make sure there is no pending resource to acquire */
 	assert(list_empty(&p->__resources_to_acquire));
@@ -261,32 +725,110 @@ static void __exit_process(struct process *p)
 	if (sched->exiting)
 		sched->exiting(p);
 
-	__print_event(p->pid, "X");
+	__trace_event(TRACE_EXIT, p->pid, 0);
+
+	__record_exit(p);
+	free(p->__holding);
+}
+
+/**
+ * Resources held by a process, in a min-heap by the age to release them.
+ * Those to release at the same age are released in the acquiring order
+ */
+static bool __releases_earlier(struct resource_schedule *a, struct resource_schedule *b)
+{
+	if (a->releases_at != b->releases_at)
+		return a->releases_at < b->releases_at;
+	return a->seq < b->seq;
+}
+
+static void __hold_resource(struct process *p, struct resource_schedule *rs)
+{
+	struct resource_schedule **heap;
+	unsigned int pos;
+
+	if (p->__nr_holding == p->__holding_slots) {
+		unsigned int nr = p->__holding_slots ? p->__holding_slots * 2 : 4;
+
+		heap = realloc(p->__holding, sizeof(*heap) * nr);
+		assert(heap && "Out of memory for the resources held");
+		p->__holding = heap;
+		p->__holding_slots = nr;
+	}
+	heap = p->__holding;
+
+	for (pos = p->__nr_holding++; pos; pos = (pos - 1) / 2) {
+		unsigned int parent = (pos - 1) / 2;
+
+		if (!__releases_earlier(rs, heap[parent]))
+			break;
+		heap[pos] = heap[parent];
+	}
+	heap[pos] = rs;
+}
+
+static struct resource_schedule *__next_release(struct process *p)
+{
+	return p->__nr_holding ? p->__holding[0] : NULL;
+}
+
+static void __unhold_resource(struct process *p)
+{
+	struct resource_schedule **heap = p->__holding;
+	struct resource_schedule *last = heap[--p->__nr_holding];
+	unsigned int pos = 0;
+
+	while (true) {
+		unsigned int child = pos * 2 + 1;
 
-	free(p);
+		if (child >= p->__nr_holding)
+			break;
+		if (child + 1 < p->__nr_holding && __releases_earlier(heap[child + 1], heap[child]))
+			child++;
+		if (!__releases_earlier(heap[child], last))
+			break;
+		heap[pos] = heap[child];
+		pos = child;
+	}
+	heap[pos] = last;
 }
 
 /**
  * Process resource acqutision
  */
-static bool __run_current_acquire()
+static struct resource_schedule *__next_acquire(struct process *p)
 {
-	struct resource_schedule *rs, *tmp;
+	if (list_empty(&p->__resources_to_acquire))
+		return NULL;
 
-	list_for_each_entry_safe(rs, tmp, &current->__resources_to_acquire, list) {
-		if (rs->at == current->age) {
-			assert(sched->acquire && "scheduler.acquire() not implemented");
+	return list_first_entry(&p->__resources_to_acquire, struct resource_schedule, list);
+}
 
-			/* Callback to acquire the resource */
-			if (!sched->acquire(rs->resource_id)) {
-				__print_event(current->pid, "=[%d]", rs->resource_id);
-				return false;
-			}
+static bool __run_current_acquire()
+{
+	struct resource_schedule *rs;
 
-			list_move_tail(&rs->list, &current->__resources_holding);
+	while ((rs = __next_acquire(current)) && rs->at == current->age) {
+		assert(sched->acquire && "scheduler.acquire() not implemented");
 
-			__print_event(current->pid, "+[%d]", rs->resource_id);
+		/* Callback to acquire the resource */
+		if (!sched->acquire(rs->resource_id)) {
+			current->__blocked_at = ticks;
+			current->__blocked_on = rs->resource_id;
+			sim->stats.resource_stats[rs->resource_id].nr_contended++;
+			__trace_event(TRACE_BLOCK, current->pid, rs->resource_id);
+			return false;
 		}
+
+		rs->acquired_at = ticks;
+		rs->releases_at = current->age + rs->duration;
+		rs->seq = sim->nr_acquisitions++;
+		sim->stats.resource_stats[rs->resource_id].nr_acquired++;
+
+		list_del_init(&rs->list);
+		__hold_resource(current, rs);
+
+		__trace_event(TRACE_ACQUIRE, current->pid, rs->resource_id);
 	}
 
 	return true;
@@ -297,89 +839,284 @@ static bool __run_current_acquire()
  */
 static void __run_current_release()
 {
-	struct resource_schedule *rs, *tmp;
+	struct resource_schedule *rs;
 
-	list_for_each_entry_safe(rs, tmp, &current->__resources_holding, list) {
-		if (--rs->duration != 0) {
-			continue;
-		}
+	while ((rs = __next_release(current)) && rs->releases_at == current->age) {
+		__unhold_resource(current);
 		assert(sched->release && "scheduler.release() not implemented");
 
 		/* Callback the release() */
 		sched->release(rs->resource_id);
+		this_cpu->__need_schedule = true;
+		sim->stats.resource_stats[rs->resource_id].hold += ticks - rs->acquired_at + 1;
 
-		__print_event(current->pid, "-[%d]", rs->resource_id);
-
-		list_del(&rs->list);
-		free(rs);
+		__trace_event(TRACE_RELEASE, current->pid, rs->resource_id);
 	}
 }
 
 /***********************************************************************
- * The main loop for the scheduler simulation
+ * Event-driven simulation
+ *
+ * Between two events (fork, acquire, release and the wake-up following it,
+ * exit, and the expiry of the scheduler's quantum), a tick either idles or
+ * ages @current by one without anything else changing. Such ticks are
+ * simulated in bulk. Schedulers are assumed to keep running @current when
+ * the ready queue is empty, and to pick nothing when there is no process at
+ * all.
  */
-static void __do_simulation(void)
+static unsigned int __next_fork_at(void)
 {
-	assert(sched->schedule && "scheduler.schedule() not implemented");
+	struct process *p = __first_fork();
 
-	while (true) {
-		struct process *prev;
+	return p ? p->__starts_at : UINT_MAX;
+}
 
-		/* Fork processes on schedule */
-		__fork_on_schedule();
+/**
+ * Return the number of ticks from now that @current of @this_cpu can run
+ * without hitting any event
+ */
+static unsigned int __uneventful_run(unsigned int next_fork)
+{
+	struct resource_schedule *rs;
+	unsigned int nr_ticks = current->lifespan - current->age;
 
-		/* Ask scheduler to pick the next process to run */
-		prev = current;
-		current = sched->schedule();
+	if (next_fork - ticks < nr_ticks)
+		nr_ticks = next_fork - ticks;
 
-		/* If the system has run a process in the previous tick */
-		if (prev) {
-			/* Update the process status */
-			if (prev->status == PROCESS_RUNNING) {
-				prev->status = PROCESS_READY;
-			}
+	if (!list_empty(&readyqueue)) {
+		if (sched->quantum <= this_cpu->__slice)
+			return 0;
+		if (sched->quantum - this_cpu->__slice < nr_ticks)
+			nr_ticks = sched->quantum - this_cpu->__slice;
+	}
 
-			/* Decommission it if completed */
-			if (prev->age == prev->lifespan) {
-				prev->status = PROCESS_EXIT;
-				__exit_process(prev);
-			}
-		}
+	rs = __next_acquire(current);
+	if (rs && rs->at >= current->age && rs->at - current->age < nr_ticks)
+		nr_ticks = rs->at - current->age;
+
+	/* Releases happen at the end of the tick aging @current to @releases_at */
+	rs = __next_release(current);
+	if (rs && rs->releases_at - current->age - 1 < nr_ticks)
+		nr_ticks = rs->releases_at - current->age - 1;
+
+	return nr_ticks;
+}
+
+/**
+ * Advance @ticks up to the next event, as if the ticks in between were
+ * simulated one by one
+ */
+static void __skip_to_next_event(void)
+{
+	unsigned int next_fork = __next_fork_at();
+	unsigned int nr_ticks = UINT_MAX;
+	bool idle = false;
+	bool ready = false;
+
+	if (next_fork <= ticks)
+		return;
+
+	for_each_cpu(cpu) {
+		this_cpu = cpu;
 
-		/* No process is ready to run at this moment */
 		if (!current) {
-			/* Quit simulation if no pending process exists */
-			if (list_empty(&readyqueue) && list_empty(&__forkqueue)) {
-				break;
-			}
+			/* The CPU is about to pick a process */
+			if (!list_empty(&readyqueue))
+				return;
+			idle = true;
+			continue;
+		}
 
-			/* Idle temporarily */
-			fprintf(stderr, "%3d: idle\n", ticks);
-		} else {
-			/* Execute the current process */
-			current->status = PROCESS_RUNNING;
+		/* @current was blocked or a waiter may have been woken up */
+		if (current->status != PROCESS_RUNNING || cpu->__need_schedule)
+			return;
 
-			/* Ensure that @current is detached from any list */
-			assert(list_empty(&current->list));
+		if (!list_empty(&readyqueue))
+			ready = true;
 
-			/* Try acquiring scheduled resources */
-			if (__run_current_acquire()) {
-				/* Succesfully acquired all the resources to make a progress */
-				__print_event(current->pid, "%d", current->pid);
+		nr_ticks = MIN(nr_ticks, __uneventful_run(next_fork));
+		if (!nr_ticks)
+			return;
+	}
+
+	/* An idle CPU would steal from a busy one */
+	if (idle && ready && __steal)
+		return;
 
-				/* So, it ages by one tick */
-				current->age++;
+	/* All CPUs are idle; wait for the next fork or let the main loop quit */
+	if (nr_ticks == UINT_MAX) {
+		if (!__first_fork())
+			return;
+		nr_ticks = next_fork - ticks;
+	}
 
-				/* And performs scheduled releases */
-				__run_current_release();
+	if (__balance_interval) {
+		if (ticks % __balance_interval == 0)
+			return;
+		nr_ticks = MIN(nr_ticks, __balance_interval - ticks % __balance_interval);
+	}
+
+	if (sim->trace_file) {
+		/* The binary trace takes the whole span at once */
+		for_each_cpu(cpu) {
+			this_cpu = cpu;
+			if (current) {
+				__trace_ticks(TRACE_RUN, current->pid, 0, nr_ticks);
 			} else {
-				/**
-				 * The current is blocked while acquiring resource(s).
-				 * In this case, @current could not make a progress in this tick.
-				 * Thus, it does not get aged nor is unable to perform releases
-				 */
+				__trace_ticks(TRACE_IDLE, 0, 0, nr_ticks);
 			}
 		}
+	} else if (__trace) {
+		for (unsigned int i = 0; i < nr_ticks; i++, ticks++) {
+			for_each_cpu(cpu) {
+				this_cpu = cpu;
+				if (current) {
+					__trace_event(TRACE_RUN, current->pid, 0);
+				} else {
+					__trace_event(TRACE_IDLE, 0, 0);
+				}
+			}
+		}
+		ticks -= nr_ticks;
+	}
+	ticks += nr_ticks;
+
+	for_each_cpu(cpu) {
+		if (!cpu->curr)
+			continue;
+
+		cpu->curr->age += nr_ticks;
+		cpu->__slice += nr_ticks;
+	}
+}
+
+/***********************************************************************
+ * Scheduling and running @this_cpu in a tick
+ */
+static void __schedule_cpu(void)
+{
+	struct process *prev;
+
+	/* Pull a ready process from the busiest CPU rather than idling */
+	if (__steal && nr_cpus > 1 && __going_idle()) {
+		struct cpu *busiest = __busiest_cpu();
+
+		if (busiest->nr_ready)
+			__pull_ready(busiest);
+	}
+
+	/* Ask scheduler to pick the next process to run */
+	prev = current;
+	current = sched->schedule();
+
+	if (current != prev) {
+		this_cpu->__slice = 0;
+		if (current) {
+			sim->stats.nr_switches++;
+			current->__nr_switches++;
+			if (current->__first_run == UINT_MAX)
+				current->__first_run = ticks;
+		}
+	}
+	this_cpu->__need_schedule = false;
+
+	/* If the system has run a process in the previous tick */
+	if (prev) {
+		/* Update the process status */
+		if (prev->status == PROCESS_RUNNING) {
+			prev->status = PROCESS_READY;
+		}
+
+		/* Decommission it if completed */
+		if (prev->age == prev->lifespan) {
+			prev->status = PROCESS_EXIT;
+			__exit_process(prev);
+		}
+	}
+
+	/**
+	 * Mark the pick running right away. Other CPUs run before this one in
+	 * the tick, and must not take it for a process in the ready queue
+	 */
+	if (current)
+		current->status = PROCESS_RUNNING;
+}
+
+static void __run_cpu(void)
+{
+	/* No process is ready to run at this moment. Idle temporarily */
+	if (!current) {
+		__trace_event(TRACE_IDLE, 0, 0);
+		return;
+	}
+
+	/* Ensure that @current is detached from any list */
+	assert(list_empty(&current->list));
+
+	/* Try acquiring scheduled resources */
+	if (__run_current_acquire()) {
+		/* Succesfully acquired all the resources to make a progress */
+		__trace_event(TRACE_RUN, current->pid, 0);
+
+		/* So, it ages by one tick */
+		current->age++;
+		this_cpu->__slice++;
+
+		/* And performs scheduled releases */
+		__run_current_release();
+	} else {
+		/**
+		 * The current is blocked while acquiring resource(s).
+		 * In this case, @current could not make a progress in this tick.
+		 * Thus, it does not get aged nor is unable to perform releases.
+		 *
+		 * With multiple CPUs, a release on another CPU may wake it up
+		 * and enqueue it in this very tick. Take it off this CPU now so
+		 * that it is never running and ready at the same time
+		 */
+		if (nr_cpus > 1)
+			current = NULL;
+	}
+}
+
+/***********************************************************************
+ * The main loop for the scheduler simulation
+ */
+static void __do_simulation(void)
+{
+	assert(sched->schedule && "scheduler.schedule() not implemented");
+
+	while (true) {
+		bool busy = false;
+
+		if (__event_driven)
+			__skip_to_next_event();
+
+		if (nr_cpus > 1 && __balance_interval && ticks % __balance_interval == 0)
+			__balance_load();
+
+		/* Fork processes on schedule */
+		__fork_on_schedule();
+
+		/* Let every CPU pick the process to run in this tick */
+		for_each_cpu(cpu) {
+			this_cpu = cpu;
+			__schedule_cpu();
+
+			if (current || !list_empty(&readyqueue))
+				busy = true;
+		}
+
+		/* Quit simulation if no pending process exists */
+		if (!busy && !__first_fork()) {
+			sim->stats.makespan = ticks;
+			break;
+		}
+
+		for_each_cpu(cpu) {
+			this_cpu = cpu;
+			__run_cpu();
+		}
 
 		/* Increase the tick counter */
 		ticks++;
@@ -388,14 +1125,18 @@ static void __do_simulation(void)
 
 static void __initialize(void)
 {
-	INIT_LIST_HEAD(&readyqueue);
-
-	for (int i = 0; i < NR_RESOURCES; i++) {
-		resources[i].owner = NULL;
-		INIT_LIST_HEAD(&(resources[i].waitqueue));
+	for (unsigned int i = 0; i < nr_cpus; i++) {
+		cpus[i] = (struct cpu) {
+			.id = i,
+		};
+		INIT_LIST_HEAD(&cpus[i].runqueue);
+
+		if (sched->rq)
+			cpus[i].__index = sched->rq->create();
 	}
+	this_cpu = cpus;
 
-	INIT_LIST_HEAD(&__forkqueue);
+	__forkqueue = RB_ROOT_CACHED;
 
 	if (quiet)
 		return;
@@ -408,6 +1149,8 @@ static void __initialize(void)
 	printf("\n");
 	printf("                                 2024 Spring\n");
 	printf("      Simulating %s scheduler\n", sched->name);
+	if (nr_cpus > 1)
+		printf("      on %u CPUs\n", nr_cpus);
 	printf("\n");
 	printf("****************************************************\n");
 	printf("   N: Forked\n");
@@ -418,79 +1161,77 @@ static void __initialize(void)
 	printf("\n");
 }
 
-static void __print_usage(char *const name)
+bool set_balance(const char *balance)
 {
-	printf("Usage: %s {-q} -[f|s|S|r|a|p|i] [process script file]\n", name);
-	printf("\n");
-	printf("  -q: Run quietly\n\n");
-	printf("  -f: Use FCFS scheduler (default)\n");
-	printf("  -s: Use SJF scheduler\n");
-	printf("  -S: Use STCF scheduler\n");
-	printf("  -r: Use Round-robin scheduler\n");
-	printf("  -p: Use Priority scheduler\n");
-	printf("  -a: Use Priority scheduler with aging\n");
-	printf("  -c: Use Priority scheduler with PCP\n");
-	printf("  -i: Use Priority scheduler with PIP\n");
-	printf("\n");
+	if (strmatch(balance, "none")) {
+		__steal = false;
+	} else if (!strmatch(balance, "idle")) {
+		__balance_interval = atoi(balance);
+		if (!__balance_interval)
+			return false;
+	}
+	return true;
 }
 
-int main(int argc, char *const argv[])
+/**
+ * Allocate the resources the script uses, which are all free
+ */
+static bool __create_resources(void)
 {
-	int opt;
-	char *scriptfile;
-
-	while ((opt = getopt(argc, argv, "qfsSrpaich")) != -1) {
-		switch (opt) {
-		case 'q':
-			quiet = true;
-			break;
-
-		case 'f':
-			sched = &fcfs_scheduler;
-			break;
-		case 's':
-			sched = &sjf_scheduler;
-			break;
-		case 'S':
-			sched = &stcf_scheduler;
-			break;
-		case 'r':
-			sched = &rr_scheduler;
-			break;
-		case 'p':
-			sched = &prio_scheduler;
-			break;
-		case 'a':
-			sched = &pa_scheduler;
-			break;
-		case 'i':
-			sched = &pip_scheduler;
-			break;
-		case 'c':
-			sched = &pcp_scheduler;
-			break;
-		case 'h':
-		default:
-			__print_usage(argv[0]);
-			return EXIT_FAILURE;
-		}
+	if (!NR_RESOURCES)
+		return true;
+
+	resources = calloc(NR_RESOURCES, sizeof(*resources));
+	sim->stats.resource_stats = calloc(NR_RESOURCES, sizeof(*sim->stats.resource_stats));
+	if (!resources || !sim->stats.resource_stats) {
+		fprintf(stderr, "Unable to allocate %u resources\n", NR_RESOURCES);
+		return false;
 	}
 
-	if (optind >= argc) {
-		__print_usage(argv[0]);
-		return EXIT_FAILURE;
+	for (unsigned int i = 0; i < NR_RESOURCES; i++) {
+		resources[i].owner = NULL;
+		INIT_LIST_HEAD(&(resources[i].waitqueue));
+		INIT_LIST_HEAD(&(resources[i].list));
 	}
+	return true;
+}
 
-	scriptfile = argv[optind];
+void init_simulation(struct simulation *s)
+{
+	memset(s, 0x00, sizeof(*s));
+	sim = s;
+
+	sched = &fcfs_scheduler;
+	nr_cpus = 1;
+	__trace = true;
+	__steal = true;
+}
+
+bool run_simulation(const char *scriptfile)
+{
+	bool ok = false;
+
+	cpus = calloc(nr_cpus, sizeof(*cpus));
+	if (!cpus) {
+		return false;
+	}
 
 	__initialize();
 
-	if (!__load_script(scriptfile)) {
-		return EXIT_FAILURE;
+	/* The script is loaded into these, and they go all together at the end */
+	init_pool(&sim->process_pool, sizeof(struct process), PROCESS_POOL_CHUNK);
+	init_pool(&sim->schedule_pool, sizeof(struct resource_schedule), SCHEDULE_POOL_CHUNK);
+
+	if (sim->trace_filename && !__open_trace(sim->trace_filename)) {
+		goto out;
+	}
+
+	if (!__load_script(scriptfile) || !__create_resources()) {
+		goto out;
 	}
 
 	if (sched->initialize && sched->initialize()) {
-		return EXIT_FAILURE;
+		goto out;
 	}
 
 	__do_simulation();
@@ -498,6 +1239,23 @@ int main(int argc, char *const argv[])
 	if (sched->finalize) {
 		sched->finalize();
 	}
+	ok = true;
+
+out:
+	__close_trace();
+
+	destroy_pool(&sim->process_pool);
+	destroy_pool(&sim->schedule_pool);
+
+	free(resources);
+	resources = NULL;
+
+	for_each_cpu(cpu) {
+		if (sched->rq)
+			sched->rq->destroy(cpu->__index);
+	}
+	free(cpus);
+	cpus = NULL;
 
-	return EXIT_SUCCESS;
+	return ok;
 }
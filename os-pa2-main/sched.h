@@ -16,6 +16,122 @@
 #ifndef __SCHED_H__
 #define __SCHED_H__
 
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "list_head.h"
+#include "rbtree.h"
+#include "resource.h"
+#include "pool.h"
+
+struct process;
+struct rq_index;
+struct trace_event;
+
+/***********************************************************************
+ * struct cpu
+ *
+ * DESCRIPTION
+ *   A processor in the simulated system (-n for more than one). Each CPU
+ *   runs its own process out of its own ready queue. The framework calls
+ *   the scheduler for each CPU in turn with @this_cpu pointing to it, and
+ *   @current and @readyqueue refer to those of @this_cpu. So a scheduler
+ *   written for a single processor works per CPU as it is.
+ */
+struct cpu {
+	unsigned int id;
+
+	struct process *curr;		/* The process running on this CPU */
+	struct list_head runqueue;	/* Processes ready to run on this CPU */
+	unsigned int nr_ready;		/* # of processes in @runqueue */
+
+	/** DO NOT ACCESS FOLLOWING VARIABLES. THESE ARE USED FOR SIMULATOR IMPLEMENTATION **/
+	struct rq_index *__index;	/* Index of the scheduler over @runqueue */
+	unsigned int __slice;		/* Ticks @curr has run since scheduled in */
+	bool __need_schedule;		/* A waiter may have been woken up */
+};
+
+/**
+ * The process that is currently running on @this_cpu
+ */
+#define current		(this_cpu->curr)
+
+/**
+ * List head to hold the processes ready to run on @this_cpu
+ */
+#define readyqueue	(this_cpu->runqueue)
+
+/***********************************************************************
+ * struct rq_ops
+ *
+ * DESCRIPTION
+ *   An index over a ready queue that lets a scheduler find the process to
+ *   run next without scanning @readyqueue. @readyqueue itself is still kept
+ *   in the enqueueing order; use enqueue_ready(), dequeue_ready() and
+ *   update_ready() rather than touching it directly so that the index of
+ *   the scheduler follows. Then peek_ready() gives the process at the head
+ *   of the index. Each CPU has an index of its own.
+ *
+ *   prio_array_rq
+ *     Array of lists per priority with a bitmap of non-empty levels, like
+ *     the O(1) scheduler in Linux. Gives the process of the highest @prio.
+ *     Among processes of the same priority, the one enqueued last wins.
+ *
+ *   lifespan_heap_rq
+ *     Binary heap giving the process of the shortest @lifespan.
+ *
+ *   remaining_heap_rq
+ *     Binary heap giving the process of the shortest @lifespan - @age.
+ *
+ *   aging_rq
+ *     Binary heap giving the process of the highest @prio, where age_ready()
+ *     boosts @prio of all ready processes by one up to MAX_PRIO in O(1).
+ *     @prio of a process is brought up to date when it is dequeued.
+ *
+ *   The heaps break ties in favor of the process enqueued first.
+ */
+struct rq_ops {
+	struct rq_index *(*create)(void);
+	void (*destroy)(struct rq_index *);
+	void (*enqueue)(struct rq_index *, struct process *);
+	void (*dequeue)(struct rq_index *, struct process *);
+	void (*update)(struct rq_index *, struct process *);
+	void (*age)(struct rq_index *);
+	struct process *(*peek)(struct rq_index *);
+};
+
+extern const struct rq_ops prio_array_rq;
+extern const struct rq_ops lifespan_heap_rq;
+extern const struct rq_ops remaining_heap_rq;
+extern const struct rq_ops aging_rq;
+
+/**
+ * Put @p at the tail of @readyqueue of @this_cpu
+ */
+void enqueue_ready(struct process *p);
+
+/**
+ * Take out @p from the ready queue it is in
+ */
+void dequeue_ready(struct process *p);
+
+/**
+ * Tell the index that the key (e.g., @prio) of @p in @readyqueue changed
+ */
+void update_ready(struct process *p);
+
+/**
+ * Boost the priority of every process in @readyqueue by one up to MAX_PRIO
+ */
+void age_ready(void);
+
+/**
+ * Return the process at the head of the index, or the first process in
+ * @readyqueue if the scheduler has no index. NULL if @readyqueue is empty.
+ * The process is not taken out of @readyqueue.
+ */
+struct process *peek_ready(void);
+
 /***********************************************************************
  * struct scheduler
  *
@@ -27,6 +143,29 @@
 struct scheduler {
 	const char *name;
 
+	/***********************************************************************
+	 * unsigned int quantum
+	 *
+	 * DESCRIPTION
+	 *   Number of ticks the scheduler keeps running @current before it may
+	 *   switch to another ready process by itself, that is, without any
+	 *   process being forked, woken up, blocked, or exited in the meantime.
+	 *   The event-driven simulation (-e) runs @current through that many
+	 *   ticks without calling schedule(). Leave it 0 (the default) if the
+	 *   scheduler may switch at every tick, and set it to UINT_MAX if it
+	 *   never preempts on its own.
+	 */
+	unsigned int quantum;
+
+	/***********************************************************************
+	 * const struct rq_ops *rq
+	 *
+	 * DESCRIPTION
+	 *   Index over the ready queue for peek_ready(). NULL to use
+	 *   @readyqueue as is.
+	 */
+	const struct rq_ops *rq;
+
 	/***********************************************************************
 	 * int initialize(void)
 	 *
@@ -113,4 +252,134 @@ struct scheduler {
 	void (*release)(int);
 };
 
+/***********************************************************************
+ * struct simulation
+ *
+ * DESCRIPTION
+ *   Everything a simulation run changes. @sim points to the one of the
+ *   calling thread, so that several simulations can run at once in a
+ *   process (see bench.c). @ticks, @resources, @quiet and the CPUs are
+ *   macros over @sim, and are accessed as if they were plain variables.
+ */
+struct process_stats {
+	unsigned int pid;
+	unsigned int starts_at;		/* When forked */
+	unsigned int first_run;		/* When scheduled for the first time */
+	unsigned int exits_at;		/* When exited */
+	unsigned int lifespan;
+	unsigned int blocked;		/* Ticks spent waiting for resources */
+	unsigned int nr_switches;	/* # of times scheduled in */
+};
+
+struct resource_stats {
+	unsigned long nr_acquired;	/* # of successful acquisitions */
+	unsigned long nr_contended;	/* # of acquisitions that got blocked */
+	unsigned long hold;			/* Ticks the resource was held */
+	unsigned long contention;	/* Ticks processes waited for the resource */
+};
+
+struct sched_stats {
+	unsigned int makespan;		/* Tick at which the last process exited */
+	unsigned int nr_exited;		/* # of processes that ran to completion */
+	unsigned long turnaround;	/* Sum of the ticks from fork to exit */
+	unsigned long wait;			/* Sum of the ticks spent in ready queues */
+	unsigned long blocked;		/* Sum of the ticks spent waiting for resources */
+	unsigned long nr_switches;	/* # of times a CPU picked another process */
+
+	/* Exited processes in the exiting order, @nr_exited of them */
+	struct process_stats *process_stats;
+	unsigned int nr_process_stats_slots;
+
+	/* Per-resource statistics, @nr_resources of them */
+	struct resource_stats *resource_stats;
+};
+
+struct simulation {
+	struct scheduler *sched;
+
+	/* Monotonically increasing ticks */
+	unsigned int ticks;
+
+	/* Resources in the system, as many as the script uses */
+	struct resource *resources;
+	unsigned int nr_resources;
+
+	/* Processors in the system, and the one being simulated */
+	struct cpu *cpus;
+	unsigned int nr_cpus;
+	struct cpu *this_cpu;
+
+	/* True to run quietly (-q) */
+	bool quiet;
+
+	/** DO NOT ACCESS FOLLOWING VARIABLES. THESE ARE USED FOR SIMULATOR IMPLEMENTATION **/
+	bool trace;					/* Print the events of each tick (-Q) */
+	bool event_driven;			/* Skip uneventful ticks (-e) */
+	bool steal;					/* Idle CPUs steal ready processes (-b) */
+	unsigned int balance_interval;	/* Even out the ready queues (-b N) */
+
+	struct rb_root_cached forkqueue;	/* Processes to fork */
+	struct pool process_pool;	/* struct process from the script */
+	struct pool schedule_pool;	/* struct resource_schedule from the script */
+	unsigned long rq_seq;		/* Enqueueing order of ready processes */
+	unsigned long nr_acquisitions;	/* Order of resource acquisitions */
+
+	const char *trace_filename;	/* Binary trace to write (-o) */
+	FILE *trace_file;
+	struct trace_event *trace_buffer;
+	unsigned int nr_trace_buffered;
+
+	struct sched_stats stats;
+};
+
+extern __thread struct simulation *sim;
+
+#define ticks		(sim->ticks)
+#define resources	(sim->resources)
+#define NR_RESOURCES	(sim->nr_resources)
+#define quiet		(sim->quiet)
+#define cpus		(sim->cpus)
+#define nr_cpus		(sim->nr_cpus)
+#define this_cpu	(sim->this_cpu)
+
+/**
+ * Make @s the simulation of the calling thread with the default options,
+ * which is to run FCFS on one CPU
+ */
+void init_simulation(struct simulation *s);
+
+/**
+ * Print the statistics of @sim to @out in @format at the end of a run
+ */
+enum stats_format {
+	STATS_NONE,
+	STATS_JSON,
+	STATS_CSV,
+};
+
+void print_stats(FILE *out, enum stats_format format);
+
+/**
+ * Free what @stats has taken during a run
+ */
+void free_stats(struct sched_stats *stats);
+
+/**
+ * Return the scheduler selected by the option letter @opt (e.g., 'r' for
+ * the round-robin scheduler), or NULL if there is no such scheduler
+ */
+struct scheduler *lookup_scheduler(char opt);
+
+/**
+ * Set the load balancing of @sim to @balance, which is "none", "idle" or
+ * the number of ticks between balancing runs. False if it is none of them
+ */
+bool set_balance(const char *balance);
+
+/**
+ * Simulate the processes in @scriptfile with the options in @sim. Return
+ * false if the script cannot be loaded or the scheduler fails to start
+ */
+bool run_simulation(const char *scriptfile);
+
 #endif
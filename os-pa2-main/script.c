@@ -0,0 +1,189 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "script.h"
+
+/**
+ * Map @filename read-only. An empty file gives an empty script rather than
+ * a mapping
+ */
+const char *map_script(const char *filename, size_t *size)
+{
+	struct stat st;
+	void *script;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	*size = st.st_size;
+	if (!*size) {
+		close(fd);
+		return "";
+	}
+
+	script = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	return script == MAP_FAILED ? NULL : script;
+}
+
+void unmap_script(const char *script, size_t size)
+{
+	if (size)
+		munmap((void *)script, size);
+}
+
+static const struct {
+	const char *keyword;
+	unsigned int len;
+	enum script_item item;
+	unsigned int nr_args;
+} __keywords[] = {
+	{ "process",  7, SCRIPT_PROCESS,  1 },
+	{ "end",      3, SCRIPT_END,      0 },
+	{ "lifespan", 8, SCRIPT_LIFESPAN, 1 },
+	{ "prio",     4, SCRIPT_PRIO,     1 },
+	{ "start",    5, SCRIPT_START,    1 },
+	{ "acquire",  7, SCRIPT_ACQUIRE,  3 },
+};
+
+void init_script_scanner(struct script_scanner *s, const char *script, size_t size)
+{
+	s->curr = script;
+	s->end = script + size;
+	s->line = 0;
+	s->word = NULL;
+	s->word_len = 0;
+}
+
+static bool __is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * Take the next word in the current line, and return its length. Return
+ * 0 at the end of the line or at a comment
+ */
+static unsigned int __next_word(struct script_scanner *s, const char **word)
+{
+	const char *curr = s->curr;
+
+	while (curr < s->end && __is_blank(*curr))
+		curr++;
+
+	*word = curr;
+	if (curr == s->end || *curr == '\n' || *curr == '#') {
+		s->curr = curr;
+		return 0;
+	}
+
+	while (curr < s->end && *curr != '\n' && !__is_blank(*curr))
+		curr++;
+
+	s->curr = curr;
+	return curr - *word;
+}
+
+static void __skip_line(struct script_scanner *s)
+{
+	const char *eol = memchr(s->curr, '\n', s->end - s->curr);
+
+	s->curr = eol ? eol + 1 : s->end;
+}
+
+static bool __parse_number(const char *word, unsigned int len, int *number)
+{
+	bool negative = false;
+	long value = 0;
+
+	if (len && *word == '-') {
+		negative = true;
+		word++;
+		len--;
+	}
+	if (!len)
+		return false;
+
+	for (; len; word++, len--) {
+		if (*word < '0' || *word > '9')
+			return false;
+		value = value * 10 + (*word - '0');
+		if (value > INT32_MAX)
+			return false;
+	}
+
+	*number = negative ? -value : value;
+	return true;
+}
+
+enum script_item script_scan(struct script_scanner *s, int args[SCRIPT_MAX_ARGS])
+{
+	while (s->curr < s->end) {
+		const char *word;
+		unsigned int len = __next_word(s, &word);
+		enum script_item item = SCRIPT_UNKNOWN;
+		unsigned int nr_args = 0;
+
+		s->line++;
+		if (!len) {
+			__skip_line(s);
+			continue;
+		}
+
+		for (unsigned int i = 0; i < sizeof(__keywords) / sizeof(*__keywords); i++) {
+			if (len == __keywords[i].len && !memcmp(word, __keywords[i].keyword, len)) {
+				item = __keywords[i].item;
+				nr_args = __keywords[i].nr_args;
+				break;
+			}
+		}
+
+		if (item == SCRIPT_UNKNOWN) {
+			s->word = word;
+			s->word_len = len;
+			__skip_line(s);
+			return item;
+		}
+
+		for (unsigned int i = 0; i < nr_args; i++) {
+			len = __next_word(s, &word);
+			if (!__parse_number(word, len, args + i))
+				item = SCRIPT_INVALID;
+		}
+		if (__next_word(s, &word))
+			item = SCRIPT_INVALID;
+
+		__skip_line(s);
+		return item;
+	}
+
+	return SCRIPT_EOF;
+}
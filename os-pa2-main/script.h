@@ -0,0 +1,103 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+
+#ifndef __SCRIPT_H__
+#define __SCRIPT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/***********************************************************************
+ * Process scripts
+ *
+ * DESCRIPTION
+ *   A script describes the processes to simulate either in text, as in
+ *   testcases/, or in the binary format sched-compile writes. Both are
+ *   mapped into memory with map_script() and read in place.
+ */
+const char *map_script(const char *filename, size_t *size);
+void unmap_script(const char *script, size_t size);
+
+/***********************************************************************
+ * Text scripts
+ *
+ * DESCRIPTION
+ *   script_scan() gives the lines of the script one by one, each as an
+ *   item and up to SCRIPT_MAX_ARGS numbers in @args. Blank lines and
+ *   comments starting with # are skipped. On SCRIPT_UNKNOWN, @word and
+ *   @word_len tell the keyword that is not known. On SCRIPT_INVALID, the
+ *   line has a wrong number of arguments or an argument is not a number.
+ */
+#define SCRIPT_MAX_ARGS	3
+
+enum script_item {
+	SCRIPT_EOF,
+	SCRIPT_PROCESS,		/* process PID */
+	SCRIPT_END,			/* end */
+	SCRIPT_LIFESPAN,	/* lifespan TICKS */
+	SCRIPT_PRIO,		/* prio PRIO */
+	SCRIPT_START,		/* start TICK */
+	SCRIPT_ACQUIRE,		/* acquire RESOURCE AT DURATION */
+	SCRIPT_UNKNOWN,
+	SCRIPT_INVALID,
+};
+
+struct script_scanner {
+	const char *curr;
+	const char *end;
+	unsigned int line;		/* Line number of the last item */
+
+	const char *word;
+	unsigned int word_len;
+};
+
+void init_script_scanner(struct script_scanner *s, const char *script, size_t size);
+enum script_item script_scan(struct script_scanner *s, int args[SCRIPT_MAX_ARGS]);
+
+/***********************************************************************
+ * Binary scripts
+ *
+ * DESCRIPTION
+ *   A struct script_header followed by a struct script_process for each
+ *   process in the order of the text script. Each process is followed by
+ *   its @nr_acquires of struct script_acquire in the order of the text
+ *   script. All are in the byte order of the host.
+ */
+#define SCRIPT_MAGIC	"SCHEDSCR"
+#define SCRIPT_VERSION	1
+
+struct script_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_processes;
+	uint64_t nr_acquires;	/* Total over all processes */
+};
+
+struct script_process {
+	int32_t pid;
+	int32_t starts_at;
+	int32_t lifespan;
+	int32_t prio;
+	uint32_t nr_acquires;
+};
+
+struct script_acquire {
+	int32_t resource_id;
+	int32_t at;
+	int32_t duration;
+};
+
+#endif
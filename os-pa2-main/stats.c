@@ -0,0 +1,161 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+
+#include "list_head.h"
+
+#include "sched.h"
+
+/**
+ * Statistics of a run in JSON or in CSV. The CSV has a row per metric,
+ * "scope,id,metric,value", where @scope is system, process or resource
+ */
+static int __compare_pid(const void *a, const void *b)
+{
+	const struct process_stats *pa = a;
+	const struct process_stats *pb = b;
+
+	if (pa->pid != pb->pid)
+		return pa->pid < pb->pid ? -1 : 1;
+	return 0;
+}
+
+static bool __resource_used(struct resource_stats *rs)
+{
+	return rs->nr_acquired || rs->nr_contended;
+}
+
+static unsigned int __turnaround(struct process_stats *ps)
+{
+	return ps->exits_at - ps->starts_at;
+}
+
+static unsigned int __wait(struct process_stats *ps)
+{
+	return __turnaround(ps) - ps->lifespan - ps->blocked;
+}
+
+static void __print_json(FILE *out, struct sched_stats *stats)
+{
+	const char *delim = "";
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"scheduler\": \"%s\",\n", sim->sched->name);
+	fprintf(out, "  \"cpus\": %u,\n", nr_cpus);
+	fprintf(out, "  \"makespan\": %u,\n", stats->makespan);
+	fprintf(out, "  \"context_switches\": %lu,\n", stats->nr_switches);
+
+	fprintf(out, "  \"processes\": [");
+	for (unsigned int i = 0; i < stats->nr_exited; i++) {
+		struct process_stats *ps = stats->process_stats + i;
+
+		fprintf(out, "%s\n    { \"pid\": %u, \"start\": %u, \"exit\": %u, "
+			"\"lifespan\": %u, \"turnaround\": %u, ", delim,
+			ps->pid, ps->starts_at, ps->exits_at, ps->lifespan, __turnaround(ps));
+		if (ps->first_run == UINT_MAX) {
+			fprintf(out, "\"response\": null, ");
+		} else {
+			fprintf(out, "\"response\": %u, ", ps->first_run - ps->starts_at);
+		}
+		fprintf(out, "\"wait\": %u, \"blocked\": %u, \"switches\": %u }",
+			__wait(ps), ps->blocked, ps->nr_switches);
+		delim = ",";
+	}
+	fprintf(out, "%s],\n", *delim ? "\n  " : "");
+
+	delim = "";
+	fprintf(out, "  \"resources\": [");
+	for (unsigned int i = 0; i < NR_RESOURCES; i++) {
+		struct resource_stats *rs = stats->resource_stats + i;
+
+		if (!__resource_used(rs))
+			continue;
+
+		fprintf(out, "%s\n    { \"id\": %u, \"acquired\": %lu, \"contended\": %lu, "
+			"\"hold\": %lu, \"contention\": %lu }", delim,
+			i, rs->nr_acquired, rs->nr_contended, rs->hold, rs->contention);
+		delim = ",";
+	}
+	fprintf(out, "%s]\n", *delim ? "\n  " : "");
+	fprintf(out, "}\n");
+}
+
+static void __print_csv(FILE *out, struct sched_stats *stats)
+{
+	fprintf(out, "scope,id,metric,value\n");
+	fprintf(out, "system,,cpus,%u\n", nr_cpus);
+	fprintf(out, "system,,makespan,%u\n", stats->makespan);
+	fprintf(out, "system,,context_switches,%lu\n", stats->nr_switches);
+
+	for (unsigned int i = 0; i < stats->nr_exited; i++) {
+		struct process_stats *ps = stats->process_stats + i;
+
+		fprintf(out, "process,%u,start,%u\n", ps->pid, ps->starts_at);
+		fprintf(out, "process,%u,exit,%u\n", ps->pid, ps->exits_at);
+		fprintf(out, "process,%u,lifespan,%u\n", ps->pid, ps->lifespan);
+		fprintf(out, "process,%u,turnaround,%u\n", ps->pid, __turnaround(ps));
+		if (ps->first_run != UINT_MAX)
+			fprintf(out, "process,%u,response,%u\n", ps->pid, ps->first_run - ps->starts_at);
+		fprintf(out, "process,%u,wait,%u\n", ps->pid, __wait(ps));
+		fprintf(out, "process,%u,blocked,%u\n", ps->pid, ps->blocked);
+		fprintf(out, "process,%u,switches,%u\n", ps->pid, ps->nr_switches);
+	}
+
+	for (unsigned int i = 0; i < NR_RESOURCES; i++) {
+		struct resource_stats *rs = stats->resource_stats + i;
+
+		if (!__resource_used(rs))
+			continue;
+
+		fprintf(out, "resource,%u,acquired,%lu\n", i, rs->nr_acquired);
+		fprintf(out, "resource,%u,contended,%lu\n", i, rs->nr_contended);
+		fprintf(out, "resource,%u,hold,%lu\n", i, rs->hold);
+		fprintf(out, "resource,%u,contention,%lu\n", i, rs->contention);
+	}
+}
+
+void print_stats(FILE *out, enum stats_format format)
+{
+	struct sched_stats *stats = &sim->stats;
+
+	if (stats->nr_exited)
+		qsort(stats->process_stats, stats->nr_exited, sizeof(*stats->process_stats),
+		      __compare_pid);
+
+	switch (format) {
+	case STATS_JSON:
+		__print_json(out, stats);
+		break;
+	case STATS_CSV:
+		__print_csv(out, stats);
+		break;
+	case STATS_NONE:
+		break;
+	}
+}
+
+void free_stats(struct sched_stats *stats)
+{
+	free(stats->process_stats);
+	stats->process_stats = NULL;
+	stats->nr_process_stats_slots = 0;
+
+	free(stats->resource_stats);
+	stats->resource_stats = NULL;
+}
@@ -0,0 +1,55 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+
+#include "trace.h"
+
+void print_trace_event(FILE *out, const struct trace_event *event,
+		       unsigned int tick, unsigned int nr_processors)
+{
+	int indent = event->pid * 4;
+
+	/* The CPU is shown only if there are many */
+	if (nr_processors > 1) {
+		fprintf(out, "%3d.%u: ", tick, event->cpu);
+	} else {
+		fprintf(out, "%3d: ", tick);
+	}
+
+	switch (event->type) {
+	case TRACE_FORK:
+		fprintf(out, "%*sN\n", indent, "");
+		break;
+	case TRACE_EXIT:
+		fprintf(out, "%*sX\n", indent, "");
+		break;
+	case TRACE_RUN:
+		fprintf(out, "%*s%u\n", indent, "", event->pid);
+		break;
+	case TRACE_IDLE:
+		fprintf(out, "idle\n");
+		break;
+	case TRACE_ACQUIRE:
+		fprintf(out, "%*s\b\b+[%u]\n", indent, "", event->resource_id);
+		break;
+	case TRACE_BLOCK:
+		fprintf(out, "%*s\b\b=[%u]\n", indent, "", event->resource_id);
+		break;
+	case TRACE_RELEASE:
+		fprintf(out, "%*s\b\b-[%u]\n", indent, "", event->resource_id);
+		break;
+	}
+}
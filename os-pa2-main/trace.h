@@ -0,0 +1,68 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/***********************************************************************
+ * Binary trace of a simulation (sched -o)
+ *
+ * DESCRIPTION
+ *   A struct trace_header followed by struct trace_event records in the
+ *   order they happened, all in the byte order of the host. Each event is
+ *   what a line of the text trace tells. Ticks skipped by -e are recorded
+ *   as a run of TRACE_RUN or TRACE_IDLE events, one per CPU, sharing the
+ *   same @tick and @nr_ticks; the CPUs take turns in every tick of them.
+ */
+#define TRACE_MAGIC		"SCHEDTRC"
+#define TRACE_VERSION	1
+
+struct trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_processors;
+	char scheduler[64];		/* Name of the scheduler */
+};
+
+enum trace_type {
+	TRACE_FORK,
+	TRACE_EXIT,
+	TRACE_RUN,
+	TRACE_IDLE,
+	TRACE_ACQUIRE,
+	TRACE_BLOCK,
+	TRACE_RELEASE,
+};
+
+struct trace_event {
+	uint32_t tick;
+	uint32_t pid;
+	uint32_t nr_ticks;		/* # of ticks TRACE_RUN and TRACE_IDLE last */
+	uint32_t resource_id;	/* For TRACE_ACQUIRE, TRACE_BLOCK, and TRACE_RELEASE */
+	uint16_t cpu;
+	uint16_t type;			/* enum trace_type */
+};
+
+/**
+ * Print @event as a line of the text trace for @tick, which is within the
+ * ticks the event lasts
+ */
+void print_trace_event(FILE *out, const struct trace_event *event,
+		       unsigned int tick, unsigned int nr_processors);
+
+#endif
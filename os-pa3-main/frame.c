@@ -0,0 +1,305 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "list_head.h"
+#include "frame.h"
+
+#define BITS_PER_WORD	64
+
+static enum frame_allocator __allocator;
+static unsigned int __nr_frames;
+static unsigned int __nr_free;
+
+/***********************************************************************
+ * Bitmap allocator
+ */
+static uint64_t *__free_map;		/* A bit per frame, set if free */
+static uint64_t *__free_summary;	/* A bit per word of @__free_map, set if not 0 */
+static unsigned int __nr_words;
+static unsigned int __nr_summary_words;
+static unsigned int __first_summary;	/* No free frame before this summary word */
+
+static void __set_free(unsigned int pfn)
+{
+	unsigned int word = pfn / BITS_PER_WORD;
+
+	__free_map[word] |= 1ULL << (pfn % BITS_PER_WORD);
+	__free_summary[word / BITS_PER_WORD] |= 1ULL << (word % BITS_PER_WORD);
+
+	if (word / BITS_PER_WORD < __first_summary)
+		__first_summary = word / BITS_PER_WORD;
+}
+
+static void __clear_free(unsigned int pfn, unsigned int nr)
+{
+	for (unsigned int i = pfn; i < pfn + nr; i++) {
+		unsigned int word = i / BITS_PER_WORD;
+
+		__free_map[word] &= ~(1ULL << (i % BITS_PER_WORD));
+		if (!__free_map[word])
+			__free_summary[word / BITS_PER_WORD] &= ~(1ULL << (word % BITS_PER_WORD));
+	}
+}
+
+static bool __bitmap_init(void)
+{
+	__nr_words = (__nr_frames + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	__nr_summary_words = (__nr_words + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+	__free_map = calloc(__nr_words, sizeof(*__free_map));
+	__free_summary = calloc(__nr_summary_words, sizeof(*__free_summary));
+	if (!__free_map || !__free_summary)
+		return false;
+
+	for (unsigned int pfn = 0; pfn < __nr_frames; pfn++) {
+		__set_free(pfn);
+	}
+	__first_summary = 0;
+	return true;
+}
+
+static unsigned int __bitmap_alloc_frame(void)
+{
+	for (; __first_summary < __nr_summary_words; __first_summary++) {
+		uint64_t summary = __free_summary[__first_summary];
+		unsigned int word;
+		unsigned int pfn;
+
+		if (!summary)
+			continue;
+
+		word = __first_summary * BITS_PER_WORD + __builtin_ctzll(summary);
+		pfn = word * BITS_PER_WORD + __builtin_ctzll(__free_map[word]);
+
+		__clear_free(pfn, 1);
+		return pfn;
+	}
+	return NO_FRAME;
+}
+
+static bool __bitmap_is_free(unsigned int pfn, unsigned int nr)
+{
+	for (unsigned int i = pfn; i < pfn + nr; i++) {
+		if (!(__free_map[i / BITS_PER_WORD] & (1ULL << (i % BITS_PER_WORD))))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Contiguous frames are rare, and are looked for frame by frame
+ */
+static unsigned int __bitmap_alloc_frames(unsigned int order)
+{
+	unsigned int nr = 1U << order;
+
+	if (!order)
+		return __bitmap_alloc_frame();
+
+	for (unsigned int pfn = 0; pfn + nr <= __nr_frames; pfn += nr) {
+		if (__bitmap_is_free(pfn, nr)) {
+			__clear_free(pfn, nr);
+			return pfn;
+		}
+	}
+	return NO_FRAME;
+}
+
+static void __bitmap_free_frames(unsigned int pfn, unsigned int order)
+{
+	for (unsigned int i = pfn; i < pfn + (1U << order); i++) {
+		assert(!__bitmap_is_free(i, 1) && "Freeing a free frame");
+		__set_free(i);
+	}
+}
+
+static void __bitmap_fini(void)
+{
+	free(__free_map);
+	free(__free_summary);
+	__free_map = __free_summary = NULL;
+}
+
+/***********************************************************************
+ * Buddy allocator
+ *
+ * The first frame of a free block is listed in @__free_lists of the order
+ * of the block through @__links, and @__orders holds the order. The other
+ * frames have NOT_FREE there.
+ */
+#define NOT_FREE	0xff
+
+static struct list_head __free_lists[MAX_FRAME_ORDER + 1];
+static struct list_head *__links;
+static unsigned char *__orders;
+
+static unsigned int __pfn_of(struct list_head *link)
+{
+	return link - __links;
+}
+
+static void __buddy_add(unsigned int pfn, unsigned int order)
+{
+	__orders[pfn] = order;
+	list_add_tail(__links + pfn, __free_lists + order);
+}
+
+static void __buddy_del(unsigned int pfn)
+{
+	__orders[pfn] = NOT_FREE;
+	list_del_init(__links + pfn);
+}
+
+static bool __buddy_init(void)
+{
+	unsigned int pfn = 0;
+
+	__links = calloc(__nr_frames, sizeof(*__links));
+	__orders = calloc(__nr_frames, sizeof(*__orders));
+	if (!__links || !__orders)
+		return false;
+
+	for (unsigned int order = 0; order <= MAX_FRAME_ORDER; order++) {
+		INIT_LIST_HEAD(__free_lists + order);
+	}
+
+	for (unsigned int i = 0; i < __nr_frames; i++) {
+		__orders[i] = NOT_FREE;
+		INIT_LIST_HEAD(__links + i);
+	}
+
+	/* Carve the frames into the largest aligned blocks that fit */
+	while (pfn < __nr_frames) {
+		unsigned int order = 0;
+
+		while (order < MAX_FRAME_ORDER &&
+				!(pfn & ((2U << order) - 1)) && pfn + (2U << order) <= __nr_frames)
+			order++;
+
+		__buddy_add(pfn, order);
+		pfn += 1U << order;
+	}
+	return true;
+}
+
+static unsigned int __buddy_alloc_frames(unsigned int order)
+{
+	for (unsigned int o = order; o <= MAX_FRAME_ORDER; o++) {
+		unsigned int pfn;
+
+		if (list_empty(__free_lists + o))
+			continue;
+
+		pfn = __pfn_of(__free_lists[o].next);
+		__buddy_del(pfn);
+
+		/* Give back the upper halves */
+		while (o > order) {
+			o--;
+			__buddy_add(pfn + (1U << o), o);
+		}
+		return pfn;
+	}
+	return NO_FRAME;
+}
+
+static void __buddy_free_frames(unsigned int pfn, unsigned int order)
+{
+	assert(__orders[pfn] == NOT_FREE && "Freeing a free frame");
+
+	while (order < MAX_FRAME_ORDER) {
+		unsigned int buddy = pfn ^ (1U << order);
+
+		if (buddy >= __nr_frames || __orders[buddy] != order)
+			break;
+
+		__buddy_del(buddy);
+		if (buddy < pfn)
+			pfn = buddy;
+		order++;
+	}
+	__buddy_add(pfn, order);
+}
+
+static void __buddy_fini(void)
+{
+	free(__links);
+	free(__orders);
+	__links = NULL;
+	__orders = NULL;
+}
+
+/***********************************************************************
+ * Interface
+ */
+bool init_frames(unsigned int nr_frames, enum frame_allocator allocator)
+{
+	__allocator = allocator;
+	__nr_frames = nr_frames;
+	__nr_free = nr_frames;
+
+	if (__allocator == FRAME_BUDDY)
+		return __buddy_init();
+	return __bitmap_init();
+}
+
+void fini_frames(void)
+{
+	if (__allocator == FRAME_BUDDY) {
+		__buddy_fini();
+	} else {
+		__bitmap_fini();
+	}
+}
+
+unsigned int alloc_frames(unsigned int order)
+{
+	unsigned int pfn;
+
+	if (order > MAX_FRAME_ORDER)
+		return NO_FRAME;
+
+	if (__allocator == FRAME_BUDDY) {
+		pfn = __buddy_alloc_frames(order);
+	} else {
+		pfn = __bitmap_alloc_frames(order);
+	}
+
+	if (pfn != NO_FRAME)
+		__nr_free -= 1U << order;
+	return pfn;
+}
+
+void free_frames(unsigned int pfn, unsigned int order)
+{
+	assert(pfn + (1U << order) <= __nr_frames);
+
+	if (__allocator == FRAME_BUDDY) {
+		__buddy_free_frames(pfn, order);
+	} else {
+		__bitmap_free_frames(pfn, order);
+	}
+	__nr_free += 1U << order;
+}
+
+unsigned int nr_free_frames(void)
+{
+	return __nr_free;
+}
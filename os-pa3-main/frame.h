@@ -0,0 +1,53 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include <stdbool.h>
+
+/**
+ * Physical page frame allocator
+ *
+ * The bitmap allocator (default) hands out the free frame of the smallest
+ * PFN. A bitmap tells the free frames, and a summary bitmap tells the words
+ * of it having a free frame, so a free frame is found with two
+ * __builtin_ctzll() on top of the first word of the summary not full.
+ *
+ * The buddy allocator (-B) keeps free blocks of 2^order frames in a list for
+ * each order, splitting a larger block on allocation and merging a block
+ * with its buddy on free. Any order is O(MAX_FRAME_ORDER), and blocks of an
+ * order are aligned to their size. It does not promise the smallest PFN.
+ */
+#define NO_FRAME		((unsigned int)-1)
+#define MAX_FRAME_ORDER	20
+
+enum frame_allocator {
+	FRAME_BITMAP,
+	FRAME_BUDDY,
+};
+
+bool init_frames(unsigned int nr_frames, enum frame_allocator allocator);
+void fini_frames(void);
+
+/**
+ * Allocate 2^@order contiguous frames aligned to their size, and return the
+ * first PFN of them. NO_FRAME if not available.
+ */
+unsigned int alloc_frames(unsigned int order);
+void free_frames(unsigned int pfn, unsigned int order);
+
+unsigned int nr_free_frames(void);
+
+#endif
@@ -0,0 +1,179 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <getopt.h>
+
+#include "list_head.h"
+#include "vm.h"
+#include "pagetable.h"
+#include "sim.h"
+
+static void __print_usage(const char * name)
+{
+	printf("Usage: %s {-q} {-t} {-s SIZE} {-w WAYS} {-c} {-m FRAMES} {-B} {-S SLOTS} {-r POLICY} {-p} {-L BITS} {-W ENTRIES} {-C COSTS} {-k} {-R} {-n} {-f [workload file]}\n", name);
+	printf("\n");
+	printf("  -t: Show TLB result, and the TLB counters at exit\n");
+	printf("  -s: Use SIZE TLB entries (default %d)\n", NR_TLB_ENTRIES);
+	printf("  -w: Make the TLB WAYS-way set-associative (default %d)\n", DEFAULT_TLB_WAYS);
+	printf("      SIZE and WAYS are powers of two, and WAYS is up to SIZE\n");
+	printf("  -c: Replace TLB entries by clock rather than by LRU\n");
+	printf("  -m: Simulate FRAMES page frames (default %d)\n", NR_PAGEFRAMES);
+	printf("  -B: Allocate page frames with the buddy allocator. Free frames are\n");
+	printf("      not handed out in the PFN order then\n");
+	printf("  -S: Evict pages to SLOTS swap slots when frames run out (default 0)\n");
+	printf("  -r: Pick the page to evict by POLICY (default clock), which is\n");
+	for (struct replacement_policy **r = replacement_policies; *r; r++) {
+		printf("      %-5s: %s\n", (*r)->name, (*r)->description);
+	}
+	printf("  -p: Show the paging counters at exit\n");
+	printf("  -L: Split VPNs into page table levels of BITS,BITS,... bits from the\n");
+	printf("      top level, up to %d levels and 32 bits (default %d,%d)\n",
+			MAX_PT_LEVELS, PDES_PER_PAGE_SHIFT, PTES_PER_PAGE_SHIFT);
+	printf("  -W: Cache ENTRIES entries of the upper levels in the page-walk cache\n");
+	printf("  -C: Take COSTS of HIT,STEP,FAULT cycles for a TLB hit, a step of page\n");
+	printf("      walks, and a page fault (default %d,%d,%d)\n",
+			DEFAULT_TLB_HIT_CYCLES, DEFAULT_WALK_STEP_CYCLES, DEFAULT_FAULT_CYCLES);
+	printf("  -k: Show the translation cost at exit\n");
+	printf("  -R: Compile the whole workload first, and replay it\n");
+	printf("  -n: Do not show the result of each access\n");
+	printf("  -q: Run quietly\n\n");
+}
+
+int main(int argc, char * argv[])
+{
+	int opt;
+	FILE *input = stdin;
+	bool replay = false;
+
+	replacement = lookup_replacement("clock");
+
+	while ((opt = getopt(argc, argv, "qhts:w:cm:BS:r:pL:W:C:kRn")) != -1) {
+		switch (opt) {
+		case 'q':
+			verbose = false;
+			break;
+		case 't':
+			print_tlb_result = true;
+			break;
+		case 's':
+			nr_tlb_entries = atoi(optarg);
+			break;
+		case 'w':
+			tlb_ways = atoi(optarg);
+			break;
+		case 'c':
+			tlb_replacement = TLB_CLOCK;
+			break;
+		case 'm':
+			nr_pageframes = atoi(optarg);
+			break;
+		case 'B':
+			frame_allocator = FRAME_BUDDY;
+			break;
+		case 'S':
+			nr_swap_slots = atoi(optarg);
+			break;
+		case 'r':
+			replacement = lookup_replacement(optarg);
+			if (!replacement) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'p':
+			print_swap_stats = true;
+			break;
+		case 'W':
+			nr_pwc_entries = atoi(optarg);
+			break;
+		case 'C':
+			if (!set_translation_costs(optarg)) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'k':
+			print_translation_stats = true;
+			break;
+		case 'R':
+			replay = true;
+			break;
+		case 'n':
+			print_accesses = false;
+			break;
+		case 'L':
+			if (!set_pt_geometry(optarg)) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+		default:
+			__print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!check_system()) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (verbose && !argv[optind]) {
+		printf("*******************************************************\n");
+		printf("            V M     S I M U L A T O R\n");
+		printf("\n");
+		printf("                                   >> 2024 Spring <<\n");
+		printf("\n");
+		printf("********************************************************\n");
+	}
+
+	if (argv[optind]) {
+		if (verbose) printf("Use file \"%s\" for input.\n", argv[optind]);
+
+		input = fopen(argv[optind], "r");
+		if (!input) {
+			fprintf(stderr, "No input file %s\n", argv[optind]);
+			return EXIT_FAILURE;
+		}
+		verbose = false;
+	} else {
+		if (verbose) printf("Use stdin for input.\n");
+	}
+
+	if (verbose) {
+		printf("Type 'help' or '?' for help.\n\n");
+		printf("%d >> ", current->pid);
+	}
+
+	if (replay) {
+		replay_simulation(input);
+	} else {
+		do_simulation(input);
+	}
+
+	if (print_tlb_result) show_tlb_stats();
+	if (print_swap_stats) show_swap_stats();
+	if (print_translation_stats) show_translation_stats();
+
+	if (input != stdin) fclose(input);
+
+	fini_system();
+
+	return EXIT_SUCCESS;
+}
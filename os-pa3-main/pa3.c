@@ -15,9 +15,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "list_head.h"
+#include "hash.h"
 #include "vm.h"
+#include "frame.h"
+#include "swap.h"
+#include "pagetable.h"
 
 /**
  * Ready queue of the system
@@ -40,10 +46,152 @@ extern struct pagetable *ptbr;
 extern struct tlb_entry tlb[];
 
 /**
- * The number of mappings for each page frame. Can be used to determine how
- * many processes are using the page frames.
+ * The number of mappings for each of the @nr_pageframes page frames. Can be
+ * used to determine how many processes are using the page frames. The free
+ * ones are handed out by alloc_frames() in frame.h.
  */
-extern unsigned int mapcounts[];
+extern unsigned int nr_pageframes;
+extern unsigned int *mapcounts;
+
+/**
+ * Geometry and replacement policy of the TLB, and its counters. See vm.h
+ */
+extern unsigned int nr_tlb_entries;
+extern unsigned int tlb_ways;
+extern enum tlb_replacement tlb_replacement;
+extern struct tlb_stats tlb_stats;
+
+/**
+ * Swap slots, page replacement policy, and paging counters. See swap.h
+ */
+extern unsigned int nr_swap_slots;
+extern struct replacement_policy *replacement;
+extern struct swap_stats swap_stats;
+
+/**
+ * The first @nr_tlb_entries of @tlb[] are split into sets of @tlb_ways
+ * entries each, one after another, and a VPN is cached only in the set
+ * its low bits select.
+ */
+static unsigned long tlb_clock = 0;          /* Ticks on every TLB use, for LRU */
+static unsigned int tlb_hands[NR_TLB_ENTRIES]; /* Clock hand of each set */
+
+/**
+ * ASIDs are handed out in order during a generation. A process keeps its
+ * ASID while @asid_generation matches, so that its TLB entries survive
+ * switches. Running out of ASIDs flushes the TLB and starts over.
+ */
+static unsigned long asid_generation = 1;
+static unsigned int next_asid = 1;      /* ASID 0 is of init to begin with */
+
+static unsigned int __current_asid(void)
+{
+    if (current->asid_generation != asid_generation)
+    {
+        if (next_asid == NR_ASIDS)
+        {
+            for (unsigned int i = 0; i < NR_TLB_ENTRIES; i++)
+            {
+                tlb[i].valid = false;
+            }
+            asid_generation++;
+            next_asid = 0;
+        }
+        current->asid = next_asid++;
+        current->asid_generation = asid_generation;
+    }
+    return current->asid;
+}
+
+static unsigned int __nr_tlb_sets(void)
+{
+    return nr_tlb_entries / tlb_ways;
+}
+
+static struct tlb_entry *__tlb_set(unsigned int vpn)
+{
+    return tlb + (vpn & (__nr_tlb_sets() - 1)) * tlb_ways;
+}
+
+/**
+ * An entry of a huge page caches 2^@shift pages, and is put in the set of
+ * its VPN >> @shift. @tlb_shifts has bit @shift set once such an entry is
+ * inserted, so the lookup tries only the page sizes ever cached.
+ */
+static unsigned int tlb_shifts = 1;
+
+static struct tlb_entry *__find_tlb_entry(unsigned int vpn, unsigned int asid, unsigned int shift)
+{
+    struct tlb_entry *set = __tlb_set(vpn >> shift);
+
+    for (unsigned int i = 0; i < tlb_ways; i++)
+    {
+        if (set[i].valid && set[i].shift == shift && set[i].asid == asid &&
+            (set[i].vpn >> shift) == (vpn >> shift))
+        {
+            return set + i;
+        }
+    }
+    return NULL;
+}
+
+static struct tlb_entry *__find_tlb_asid(unsigned int vpn, unsigned int asid)
+{
+    for (unsigned int shifts = tlb_shifts; shifts; shifts &= shifts - 1)
+    {
+        struct tlb_entry *t = __find_tlb_entry(vpn, asid, __builtin_ctz(shifts));
+
+        if (t)
+        {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static struct tlb_entry *__find_tlb(unsigned int vpn)
+{
+    return __find_tlb_asid(vpn, __current_asid());
+}
+
+static void __touch_tlb(struct tlb_entry *t)
+{
+    t->last_used = ++tlb_clock;
+    t->referenced = true;
+}
+
+/**
+ * Pick the entry to evict from the full @set. LRU takes the one used the
+ * longest ago, and clock sweeps the hand over the set, giving a second
+ * chance to the entries referenced since the last sweep.
+ */
+static struct tlb_entry *__tlb_victim(struct tlb_entry *set, unsigned int set_index)
+{
+    struct tlb_entry *victim = set;
+
+    if (tlb_replacement == TLB_CLOCK)
+    {
+        unsigned int *hand = tlb_hands + set_index;
+
+        while (set[*hand].referenced)
+        {
+            set[*hand].referenced = false;
+            *hand = (*hand + 1) % tlb_ways;
+        }
+        victim = set + *hand;
+        *hand = (*hand + 1) % tlb_ways;
+        return victim;
+    }
+
+    for (unsigned int i = 1; i < tlb_ways; i++)
+    {
+        if (set[i].last_used < victim->last_used)
+        {
+            victim = set + i;
+        }
+    }
+    return victim;
+}
 
 /**
  * lookup_tlb(@vpn, @rw, @pfn)
@@ -51,9 +199,9 @@ extern unsigned int mapcounts[];
  * DESCRIPTION
  *   Translate @vpn of the current process through TLB. DO NOT make your own
  *   data structure for TLB, but should use the defined @tlb data structure
- *   to translate. If the requested VPN exists in the TLB and it has the same
- *   rw flag, return true with @pfn is set to its PFN. Otherwise, return false.
- *   The framework calls this function when needed, so do not call
+ *   to translate. If the requested VPN exists in the TLB and it allows the
+ *   @rw access, return true with @pfn is set to its PFN. Otherwise, return
+ *   false. The framework calls this function when needed, so do not call
  *   this function manually.
  *
  * RETURN
@@ -62,128 +210,618 @@ extern unsigned int mapcounts[];
  */
 bool lookup_tlb(unsigned int vpn, unsigned int rw, unsigned int *pfn)
 {
-    for (int i = 0; i < NR_PAGEFRAMES; i++)
+    struct tlb_entry *t = __find_tlb(vpn);
+
+    if (!t || (t->rw & rw) != rw)
     {
-        if (tlb[i].valid && tlb[i].vpn == vpn && tlb[i].rw == rw)
+        return false;
+    }
+
+    __touch_tlb(t);
+    *pfn = t->pfn + (vpn - t->vpn);
+    return true;
+}
+
+/**
+ * Cache the huge page of 2^@shift pages from @vpn, which is aligned to it,
+ * to @pfn in a single entry
+ */
+void insert_huge_tlb(unsigned int vpn, unsigned int rw, unsigned int pfn, unsigned int shift)
+{
+    struct tlb_entry *set = __tlb_set(vpn >> shift);
+    struct tlb_entry *t = __find_tlb_entry(vpn, __current_asid(), shift);
+
+    if (!t)
+    {
+        for (unsigned int i = 0; i < tlb_ways; i++)
         {
-            *pfn = tlb[i].pfn;
-            return true;
+            if (!set[i].valid)
+            {
+                t = set + i;
+                break;
+            }
         }
     }
-    return false;
+
+    if (!t)
+    {
+        t = __tlb_victim(set, (set - tlb) / tlb_ways);
+        tlb_stats.nr_evictions++;
+    }
+
+    t->valid = true;
+    t->asid = __current_asid();
+    t->vpn = vpn;
+    t->rw = rw;
+    t->pfn = pfn;
+    t->shift = shift;
+    __touch_tlb(t);
+
+    tlb_shifts |= 1U << shift;
 }
 
 void insert_tlb(unsigned int vpn, unsigned int rw, unsigned int pfn)
 {
-    for (int i = 0; i < NR_PAGEFRAMES; i++)
+    insert_huge_tlb(vpn, rw, pfn, 0);
+}
+
+static void __invalidate_tlb(unsigned int vpn)
+{
+    struct tlb_entry *t = __find_tlb(vpn);
+
+    if (t)
+    {
+        t->valid = false;
+    }
+}
+
+/**
+ * Same for @process, which may not be running. Its entries are all gone
+ * if its ASID is of an old generation
+ */
+static void __invalidate_tlb_of(struct process *process, unsigned int vpn)
+{
+    struct tlb_entry *t;
+
+    if (process->asid_generation != asid_generation)
+        return;
+
+    t = __find_tlb_asid(vpn, process->asid);
+    if (t)
+    {
+        t->valid = false;
+    }
+}
+
+/**
+ * Change the cached translation of @vpn in place, if any, after its PTE of
+ * the current process is changed. @pfn is the first frame of a huge page
+ */
+static void __update_tlb(unsigned int vpn, unsigned int rw, unsigned int pfn)
+{
+    struct tlb_entry *t = __find_tlb(vpn);
+
+    if (t)
+    {
+        t->rw = rw;
+        t->pfn = pfn;
+    }
+}
+
+/**
+ * The leaf PTE of @vpn in the page table of @process, which may be of a
+ * huge page. The tables are allocated on the way if @alloc is true
+ */
+static struct pte *__get_pte_of(struct process *process, unsigned int vpn, bool alloc)
+{
+    return walk_pagetable(&process->pagetable, vpn, leaf_level(), alloc, NULL);
+}
+
+static struct pte *__get_pte(unsigned int vpn, bool alloc)
+{
+    return __get_pte_of(current, vpn, alloc);
+}
+
+/**
+ * Same as __get_pte(), telling the level of the leaf in @level
+ */
+static struct pte *__get_leaf(unsigned int vpn, unsigned int *level)
+{
+    return walk_pagetable(&current->pagetable, vpn, leaf_level(), false, level);
+}
+
+/**
+ * Reverse mappings list the (process, VPN) mapping each frame, so that a
+ * frame can be unmapped from all of them on eviction. @frame_slots holds
+ * the swap slot each frame was read from while the frame is still clean
+ * and the same as the slot.
+ */
+struct rmap
+{
+    struct process *process;
+    unsigned int vpn;
+    struct list_head list;
+};
+
+static struct list_head *rmaps;
+static unsigned int *frame_slots;
+
+/**
+ * Process table hashed by PID, holding all processes including @current
+ */
+#define PID_HASH_BITS   10
+
+static DEFINE_HASHTABLE(pid_hash, PID_HASH_BITS);
+
+static struct process *__find_process(unsigned int pid)
+{
+    struct process *p;
+
+    hash_for_each_possible(pid_hash, p, hash, pid)
     {
-        if (tlb[i].valid && tlb[i].vpn == vpn)
+        if (p->pid == pid)
         {
-            tlb[i].pfn = pfn;
-            tlb[i].rw = rw;
-            return;
+            return p;
         }
     }
+    return NULL;
+}
+
+bool init_paging(void)
+{
+    hash_add(pid_hash, &current->hash, current->pid);
+
+    rmaps = calloc(nr_pageframes, sizeof(*rmaps));
+    frame_slots = calloc(nr_pageframes, sizeof(*frame_slots));
+    if (!rmaps || !frame_slots)
+        return false;
+
+    for (unsigned int i = 0; i < nr_pageframes; i++)
+    {
+        INIT_LIST_HEAD(rmaps + i);
+        frame_slots[i] = NO_SWAP_SLOT;
+    }
+    return true;
+}
 
-    for (int i = 0; i < NR_PAGEFRAMES; i++)
+static void __add_rmap(unsigned int pfn, struct process *process, unsigned int vpn)
+{
+    struct rmap *r = malloc(sizeof(*r));
+
+    r->process = process;
+    r->vpn = vpn;
+    list_add_tail(&r->list, rmaps + pfn);
+}
+
+static void __del_rmap(unsigned int pfn, struct process *process, unsigned int vpn)
+{
+    struct rmap *r;
+
+    list_for_each_entry(r, rmaps + pfn, list)
     {
-        if (!tlb[i].valid)
+        if (r->process == process && r->vpn == vpn)
         {
-            tlb[i].valid = true;
-            tlb[i].vpn = vpn;
-            tlb[i].rw = rw;
-            tlb[i].pfn = pfn;
+            list_del(&r->list);
+            free(r);
             return;
         }
     }
 }
 
-unsigned int alloc_page(unsigned int vpn, unsigned int rw)
+bool frame_referenced(unsigned int pfn)
 {
-    for (unsigned int i = 0; i < NR_PAGEFRAMES; i++)
+    bool referenced = false;
+    struct rmap *r;
+
+    list_for_each_entry(r, rmaps + pfn, list)
     {
-        if (mapcounts[i] == 0)
-        {
-            mapcounts[i] = 1;
+        struct pte *pte = __get_pte_of(r->process, r->vpn, false);
 
-            struct pagetable_entry *pte = &current->pagetable.entries[vpn];
-            pte->valid = true;
-            pte->pfn = i;
-            pte->rw = rw;
+        referenced |= pte->referenced;
+        pte->referenced = false;
+    }
+    return referenced;
+}
 
-            insert_tlb(vpn, rw, i);
+/**
+ * Map @pfn at @vpn of the current process with @pte. A frame starts to be
+ * replaceable with its first mapping
+ */
+static void __map_frame(struct pte *pte, unsigned int vpn, unsigned int pfn)
+{
+    if (mapcounts[pfn]++ == 0)
+    {
+        replacement->mapped(pfn);
+    }
+    __add_rmap(pfn, current, vpn);
 
-            return i;
-        }
+    pte->valid = true;
+    pte->swapped = false;
+    pte->pfn = pfn;
+    pte->referenced = false;
+    pte->dirty = false;
+}
+
+static void __release_frame(unsigned int pfn)
+{
+    if (frame_slots[pfn] != NO_SWAP_SLOT)
+    {
+        put_swap_slot(frame_slots[pfn]);
+        frame_slots[pfn] = NO_SWAP_SLOT;
     }
-    return -1;
+    mapcounts[pfn] = 0;
+    free_frames(pfn, 0);
 }
 
-void free_page(unsigned int vpn)
+static void __unmap_frame(unsigned int pfn, unsigned int vpn)
 {
-    struct pagetable_entry *pte = &current->pagetable.entries[vpn];
-    if (!pte->valid)
-        return;
+    __del_rmap(pfn, current, vpn);
 
-    unsigned int pfn = pte->pfn;
     if (--mapcounts[pfn] == 0)
     {
-        pte->valid = false;
-        pte->pfn = 0;
-        pte->rw = 0;
+        replacement->unmapped(pfn);
+        __release_frame(pfn);
+    }
+}
+
+/**
+ * Write @pfn out to the swap unless it is clean and already there, and
+ * point all the PTEs mapping it to the slot
+ */
+static bool __evict_frame(unsigned int pfn)
+{
+    unsigned int slot = frame_slots[pfn];
+    bool dirty = false;
+    struct rmap *r, *tmp;
+
+    list_for_each_entry(r, rmaps + pfn, list)
+    {
+        dirty |= __get_pte_of(r->process, r->vpn, false)->dirty;
     }
 
-    for (int i = 0; i < NR_PAGEFRAMES; i++)
+    if (dirty || slot == NO_SWAP_SLOT)
     {
-        if (tlb[i].valid && tlb[i].vpn == vpn)
+        /* The slot can be overwritten if nobody else points to it */
+        if (slot == NO_SWAP_SLOT || swap_slot_count(slot) > 1)
         {
-            tlb[i].valid = false;
+            unsigned int new_slot = alloc_swap_slot();
+
+            if (new_slot == NO_SWAP_SLOT)
+                return false;
+
+            if (slot != NO_SWAP_SLOT)
+                put_swap_slot(slot);
+            slot = frame_slots[pfn] = new_slot;
         }
+        swap_stats.nr_swap_outs++;
+    }
+
+    list_for_each_entry_safe(r, tmp, rmaps + pfn, list)
+    {
+        struct pte *pte = __get_pte_of(r->process, r->vpn, false);
+
+        pte->valid = false;
+        pte->swapped = true;
+        pte->pfn = slot;
+        pte->referenced = false;
+        pte->dirty = false;
+        get_swap_slot(slot);
+
+        __invalidate_tlb_of(r->process, r->vpn);
+
+        list_del(&r->list);
+        free(r);
+    }
+
+    __release_frame(pfn);
+    swap_stats.nr_evictions++;
+    return true;
+}
+
+/**
+ * A free frame, evicting one if none. @pinned is not to be evicted
+ */
+static unsigned int __get_frame(unsigned int pinned)
+{
+    unsigned int pfn = alloc_frames(0);
+
+    if (pfn != NO_FRAME || !nr_swap_slots)
+        return pfn;
+
+    /* Frames of huge pages are not with the policy, and cannot be evicted */
+    pfn = replacement->victim();
+    if (pfn == NO_FRAME)
+        return NO_FRAME;
+
+    if (pinned != NO_FRAME && pfn == pinned)
+    {
+        pfn = replacement->victim();
+        replacement->mapped(pinned);
+    }
+    if (pfn == NO_FRAME)
+        return NO_FRAME;
+
+    if (!__evict_frame(pfn))
+    {
+        replacement->mapped(pfn);
+        return NO_FRAME;
+    }
+    return alloc_frames(0);
+}
+
+unsigned int alloc_page(unsigned int vpn, unsigned int rw)
+{
+    unsigned int pfn = __get_frame(NO_FRAME);
+    struct pte *pte;
+
+    if (pfn == NO_FRAME)
+        return -1;
+
+    pte = __get_pte(vpn, true);
+    __map_frame(pte, vpn, pfn);
+    pte->rw = rw;
+    pte->private = 0;
+
+    insert_tlb(vpn, rw, pfn);
+
+    return pfn;
+}
+
+/**
+ * Huge pages are of the frames contiguous and aligned to their size. They
+ * are not replaced nor swapped out, and every frame of them is counted in
+ * @mapcounts.
+ */
+static unsigned int __huge_order(unsigned int level)
+{
+    return pt_shifts[level];
+}
+
+static void __count_huge_frames(unsigned int pfn, unsigned int level, int delta)
+{
+    for (unsigned int i = 0; i < (1U << __huge_order(level)); i++)
+    {
+        mapcounts[pfn + i] += delta;
+    }
+}
+
+unsigned int alloc_huge_page(unsigned int vpn, unsigned int rw, unsigned int level)
+{
+    unsigned int pfn = alloc_frames(__huge_order(level));
+    struct pte *pte;
+
+    if (pfn == NO_FRAME)
+        return -1;
+
+    pte = walk_pagetable(&current->pagetable, vpn, level, true, NULL);
+    __count_huge_frames(pfn, level, 1);
+
+    pte->valid = true;
+    pte->pfn = pfn;
+    pte->rw = rw;
+
+    insert_huge_tlb(vpn, rw, pfn, __huge_order(level));
+
+    return pfn;
+}
+
+static void __free_huge_page(struct pte *pte, unsigned int level)
+{
+    __count_huge_frames(pte->pfn, level, -1);
+
+    if (mapcounts[pte->pfn] == 0)
+    {
+        free_frames(pte->pfn, __huge_order(level));
+    }
+}
+
+void free_page(unsigned int vpn)
+{
+    unsigned int level;
+    struct pte *pte = __get_leaf(vpn, &level);
+    if (!pte)
+        return;
+
+    if (pte->swapped)
+    {
+        put_swap_slot(pte->pfn);
+    }
+    else if (pte->valid && level < leaf_level())
+    {
+        __free_huge_page(pte, level);
+        __invalidate_tlb(vpn);
+    }
+    else if (pte->valid)
+    {
+        /* Other processes may still share the frame copy-on-write */
+        __unmap_frame(pte->pfn, vpn);
+        __invalidate_tlb(vpn);
+    }
+    else
+    {
+        return;
+    }
+
+    memset(pte, 0, sizeof(*pte));
+}
+
+/**
+ * Read the page of @pte back from the swap. The frame keeps the slot as
+ * long as it is clean, and the other PTEs pointing to the slot read it on
+ * their own
+ */
+static bool __swap_in(struct pte *pte, unsigned int vpn)
+{
+    unsigned int slot = pte->pfn;
+    unsigned int pfn = __get_frame(NO_FRAME);
+
+    if (pfn == NO_FRAME)
+        return false;
+
+    __map_frame(pte, vpn, pfn);
+    frame_slots[pfn] = slot;    /* Takes over the reference of @pte */
+
+    swap_stats.nr_swap_ins++;
+    swap_stats.nr_major_faults++;
+    return true;
+}
+
+/**
+ * Copy-on-write of a huge page, which is copied as a whole
+ */
+static bool __copy_huge_page(struct pte *pte, unsigned int level)
+{
+    if (mapcounts[pte->pfn] > 1)
+    {
+        unsigned int pfn = alloc_frames(__huge_order(level));
+
+        if (pfn == NO_FRAME)
+            return false;
+
+        __count_huge_frames(pte->pfn, level, -1);
+        __count_huge_frames(pfn, level, 1);
+        pte->pfn = pfn;
     }
+    return true;
 }
 
 bool handle_page_fault(unsigned int vpn, unsigned int rw)
 {
-    struct pagetable_entry *pte = &current->pagetable.entries[vpn];
+    unsigned int level;
+    struct pte *pte = __get_leaf(vpn, &level);
 
-    if (!pte->valid)
+    if (pte && pte->swapped)
     {
-        return alloc_page(vpn, rw) != -1;
+        return __swap_in(pte, vpn);
     }
-    else if (rw == ACCESS_WRITE && !pte->rw)
+    else if (!pte || !pte->valid)
     {
-        unsigned int pfn = alloc_page(vpn, ACCESS_WRITE);
-        if (pfn == -1)
+        if (alloc_page(vpn, rw) == (unsigned int)-1)
             return false;
 
-        pte->rw = ACCESS_WRITE;
+        swap_stats.nr_minor_faults++;
+        return true;
+    }
+    else if (rw == ACCESS_WRITE && (pte->private & ACCESS_WRITE))
+    {
+        /**
+         * Copy-on-write. The last one sharing the frame takes it over as is,
+         * and the others get a copy of their own
+         */
+        if (level < leaf_level())
+        {
+            if (!__copy_huge_page(pte, level))
+                return false;
+
+            vpn &= ~((1U << __huge_order(level)) - 1);
+        }
+        else if (mapcounts[pte->pfn] > 1)
+        {
+            unsigned int pfn = __get_frame(pte->pfn);
+
+            if (pfn == NO_FRAME)
+                return false;
+
+            __unmap_frame(pte->pfn, vpn);
+            __map_frame(pte, vpn, pfn);
+        }
+        else if (frame_slots[pte->pfn] != NO_SWAP_SLOT)
+        {
+            /* Others may read the slot back. Leave it to them */
+            put_swap_slot(frame_slots[pte->pfn]);
+            frame_slots[pte->pfn] = NO_SWAP_SLOT;
+        }
+
+        pte->rw = pte->private;
+        pte->private = 0;
+        swap_stats.nr_minor_faults++;
+
+        __update_tlb(vpn, pte->rw, pte->pfn);
         return true;
     }
 
     return false;
 }
 
-void switch_process(unsigned int pid)
+/**
+ * Fork the address space of the current process into @child. The page
+ * tables are duplicated and point to the same frames or swap slots,
+ * and the writable pages become read-only on both sides with the
+ * permission kept in @private until the copy-on-write fault.
+ */
+static struct pte *__share_table(struct pte *table, unsigned int level, unsigned int vpn,
+                                 struct process *child)
 {
-    struct process *next = NULL;
-    struct process *temp;
+    unsigned int nr_entries = 1U << pt_bits[level];
+    struct pte *copy = alloc_pt_table(level);
+
+    memcpy(copy, table, sizeof(*table) * nr_entries);
 
-    list_for_each_entry(temp, &processes, list)
+    for (unsigned int i = 0; i < nr_entries; i++)
     {
-        if (temp->pid == pid)
+        struct pte *pte = table + i;
+        unsigned int pte_vpn = vpn | (i << pt_shifts[level]);
+
+        if (!pte_is_leaf(pte))
+        {
+            if (pte->table)
+                copy[i].table = __share_table(pte->table, level + 1, pte_vpn, child);
+            continue;
+        }
+
+        if (pte->rw & ACCESS_WRITE)
+        {
+            pte->private = pte->rw;
+            pte->rw = ACCESS_READ;
+            if (pte->valid)
+                __update_tlb(pte_vpn, pte->rw, pte->pfn);
+        }
+        copy[i] = *pte;
+
+        if (pte->swapped)
+        {
+            get_swap_slot(pte->pfn);
+        }
+        else if (level < leaf_level())
+        {
+            __count_huge_frames(pte->pfn, level, 1);
+        }
+        else
         {
-            next = temp;
-            break;
+            mapcounts[pte->pfn]++;
+            __add_rmap(pte->pfn, child, pte_vpn);
         }
     }
+    return copy;
+}
+
+static void __share_pagetable(struct process *child)
+{
+    if (current->pagetable.root)
+    {
+        child->pagetable.root = __share_table(current->pagetable.root, 0, 0, child);
+    }
+}
+
+void switch_process(unsigned int pid)
+{
+    struct process *next = __find_process(pid);
+
+    if (next == current)
+    {
+        /* Leave the ready queue and the ASID as they are */
+        return;
+    }
 
     if (!next)
     {
-        next = malloc(sizeof(struct process));
+        next = calloc(1, sizeof(struct process));
         next->pid = pid;
-        memcpy(&next->pagetable, &current->pagetable, sizeof(struct pagetable));
+        next->asid_generation = 0;
+        __share_pagetable(next);
 
         list_add_tail(&next->list, &processes);
+        hash_add(pid_hash, &next->hash, pid);
     }
 
     list_del(&next->list);
@@ -191,4 +829,7 @@ void switch_process(unsigned int pid)
 
     current = next;
     ptbr = &current->pagetable;
+
+    /* No flush; the TLB entries of @next are told apart by its ASID */
+    __current_asid();
 }
@@ -0,0 +1,177 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "list_head.h"
+#include "vm.h"
+#include "pagetable.h"
+
+unsigned int nr_pt_levels = 2;
+unsigned int pt_bits[MAX_PT_LEVELS] = {
+	PDES_PER_PAGE_SHIFT,
+	PTES_PER_PAGE_SHIFT,
+};
+unsigned int pt_shifts[MAX_PT_LEVELS] = {
+	PTES_PER_PAGE_SHIFT,
+	0,
+};
+
+bool set_pt_geometry(const char *spec)
+{
+	unsigned int bits[MAX_PT_LEVELS];
+	unsigned int nr_levels = 0;
+	unsigned int total = 0;
+
+	while (*spec) {
+		char *end;
+		unsigned long b = strtoul(spec, &end, 10);
+
+		if (end == spec || nr_levels == MAX_PT_LEVELS || b < 1 || b > 16)
+			return false;
+
+		bits[nr_levels++] = b;
+		total += b;
+
+		if (*end == ',') {
+			end++;
+		} else if (*end) {
+			return false;
+		}
+		spec = end;
+	}
+
+	if (!nr_levels || total > 32)
+		return false;
+
+	nr_pt_levels = nr_levels;
+	memcpy(pt_bits, bits, sizeof(*bits) * nr_levels);
+
+	for (unsigned int l = 0; l < nr_levels; l++) {
+		total -= bits[l];
+		pt_shifts[l] = total;
+	}
+	return true;
+}
+
+struct pte *alloc_pt_table(unsigned int level)
+{
+	return calloc(1U << pt_bits[level], sizeof(struct pte));
+}
+
+struct pte *walk_pagetable(struct pagetable *pt, unsigned int vpn, unsigned int level,
+		bool alloc, unsigned int *levelp)
+{
+	struct pte **table = &pt->root;
+
+	for (unsigned int l = 0; ; l++) {
+		struct pte *pte;
+
+		if (!*table) {
+			if (!alloc)
+				return NULL;
+			*table = alloc_pt_table(l);
+		}
+
+		pte = *table + pt_index(vpn, l);
+		if (l == level || l == leaf_level() || pte_is_leaf(pte)) {
+			if (levelp)
+				*levelp = l;
+			return pte;
+		}
+		table = &pte->table;
+	}
+}
+
+/***********************************************************************
+ * Page-walk cache
+ *
+ * Fully associative, and replaced by LRU
+ */
+static struct pwc_entry *__pwc;
+static unsigned int __nr_pwc_entries;
+static unsigned long __pwc_clock;
+
+bool init_pwc(unsigned int nr_entries)
+{
+	__nr_pwc_entries = nr_entries;
+	if (!nr_entries)
+		return true;
+
+	__pwc = calloc(nr_entries, sizeof(*__pwc));
+	return __pwc;
+}
+
+void fini_pwc(void)
+{
+	free(__pwc);
+	__pwc = NULL;
+	__nr_pwc_entries = 0;
+}
+
+static bool __pwc_match(struct pwc_entry *e, struct pagetable *pt, unsigned int vpn)
+{
+	return e->valid && e->pt == pt && e->prefix == vpn >> pt_shifts[e->level];
+}
+
+struct pte *lookup_pwc(struct pagetable *pt, unsigned int vpn, unsigned int *level)
+{
+	struct pwc_entry *deepest = NULL;
+
+	for (unsigned int i = 0; i < __nr_pwc_entries; i++) {
+		struct pwc_entry *e = __pwc + i;
+
+		if (__pwc_match(e, pt, vpn) && (!deepest || e->level > deepest->level))
+			deepest = e;
+	}
+
+	if (!deepest)
+		return NULL;
+
+	deepest->last_used = ++__pwc_clock;
+	*level = deepest->level + 1;
+	return deepest->table;
+}
+
+void insert_pwc(struct pagetable *pt, unsigned int vpn, unsigned int level, struct pte *table)
+{
+	struct pwc_entry *victim = NULL;
+
+	for (unsigned int i = 0; i < __nr_pwc_entries; i++) {
+		struct pwc_entry *e = __pwc + i;
+
+		if (e->valid && e->pt == pt && e->level == level &&
+				e->prefix == vpn >> pt_shifts[level]) {
+			victim = e;
+			break;
+		}
+		if (!victim || !e->valid || (victim->valid && e->last_used < victim->last_used))
+			victim = e;
+	}
+
+	if (!victim)
+		return;
+
+	*victim = (struct pwc_entry) {
+		.valid = true,
+		.pt = pt,
+		.level = level,
+		.prefix = vpn >> pt_shifts[level],
+		.table = table,
+		.last_used = ++__pwc_clock,
+	};
+}
@@ -0,0 +1,101 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+#ifndef __PAGETABLE_H__
+#define __PAGETABLE_H__
+
+#include <stdbool.h>
+
+#include "vm.h"
+
+/**
+ * Geometry of the page tables. Level 0 is the top level, and the VPN bits
+ * are split into @pt_bits[] from the most significant ones. The default is
+ * the 2-level one of PDES_PER_PAGE_SHIFT and PTES_PER_PAGE_SHIFT. VPNs are
+ * unsigned int, so all levels take up to 32 bits in total.
+ */
+#define MAX_PT_LEVELS	6
+
+extern unsigned int nr_pt_levels;
+extern unsigned int pt_bits[MAX_PT_LEVELS];
+extern unsigned int pt_shifts[MAX_PT_LEVELS];	/* VPN bits below each level */
+
+/**
+ * Set the geometry from "BITS[,BITS...]" of each level from the top
+ */
+bool set_pt_geometry(const char *spec);
+
+/* An entry at @level covers 2^pt_shifts[@level] pages */
+static inline unsigned int pt_index(unsigned int vpn, unsigned int level)
+{
+	return (vpn >> pt_shifts[level]) & ((1U << pt_bits[level]) - 1);
+}
+
+static inline unsigned long nr_vpns(void)
+{
+	return 1UL << (pt_shifts[0] + pt_bits[0]);
+}
+
+static inline unsigned int leaf_level(void)
+{
+	return nr_pt_levels - 1;
+}
+
+/**
+ * Whether @pte maps a page or a huge page, or is swapped out. Otherwise it
+ * points to the table of the next level, if any.
+ */
+static inline bool pte_is_leaf(struct pte *pte)
+{
+	return pte->valid || pte->swapped;
+}
+
+/**
+ * Walk down @pt to the entry of @vpn at @level, or to the huge leaf above
+ * it. The tables on the way are allocated if @alloc is set; otherwise NULL
+ * when one of them is missing. The level reached is put in @levelp if given
+ */
+struct pte *walk_pagetable(struct pagetable *pt, unsigned int vpn, unsigned int level,
+		bool alloc, unsigned int *levelp);
+
+struct pte *alloc_pt_table(unsigned int level);
+
+/**
+ * Page-walk cache of the entries above the last level, like the paging
+ * structure caches of x86. An entry holds the table of the next level that
+ * the entry of @level for the VPNs of @prefix points to. Tables are never
+ * freed nor moved, so the entries never go stale. They are tagged with the
+ * page table itself rather than with an ASID.
+ */
+struct pwc_entry {
+	bool valid;
+	struct pagetable *pt;
+	unsigned int level;
+	unsigned int prefix;		/* VPN >> pt_shifts[@level] */
+	struct pte *table;
+
+	unsigned long last_used;
+};
+
+bool init_pwc(unsigned int nr_entries);
+void fini_pwc(void);
+
+/**
+ * The table of the deepest level cached for @vpn, or NULL. @level is set to
+ * the level of the table
+ */
+struct pte *lookup_pwc(struct pagetable *pt, unsigned int vpn, unsigned int *level);
+void insert_pwc(struct pagetable *pt, unsigned int vpn, unsigned int level, struct pte *table);
+
+#endif
@@ -19,35 +19,76 @@
 
 #include "parser.h"
 
-int parse_command(char *command, char *tokens[])
+/**
+ * Copy the token starting at @curr to @out while removing quotes and
+ * backslashes. @out never goes past @curr, so the dequoted token can be
+ * built in place. Return the position after the token, or NULL if a quote
+ * is left open.
+ */
+static char *__scan_token(char *curr, char *out, char **end)
 {
-	char *curr = command;
-	int token_started = false;
-	int nr_tokens = 0;
+	while (*curr && !isspace((unsigned char)*curr)) {
+		char quote;
 
-	while (*curr != '\0') {
-		if (isspace(*curr)) {
-			*curr = '\0';
-			token_started = false;
-		} else {
-			if (!token_started) {
-				tokens[nr_tokens] = curr;
-				nr_tokens += 1;
-				token_started = true;
+		switch (*curr) {
+		case '\\':
+			curr++;
+			if (*curr == '\n') {
+				/* Backslash-newline is a line continuation */
+				curr++;
+			} else if (*curr) {
+				*out++ = *curr++;
 			}
+			break;
+		case '\'':
+		case '"':
+			quote = *curr++;
+			while (*curr && *curr != quote) {
+				/* Only a few characters are escaped within "..." */
+				if (quote == '"' && *curr == '\\' &&
+						curr[1] && strchr("\"\\$`", curr[1])) {
+					curr++;
+				}
+				*out++ = *curr++;
+			}
+			if (!*curr) return NULL;
+			curr++;
+			break;
+		default:
+			*out++ = *curr++;
 		}
-
-		curr++;
 	}
+	*end = out;
+	return curr;
+}
 
-	/* Remove comments */
-	for (int i = 0; i < nr_tokens; i++) {
-		if (strncmp(tokens[i], "#", strlen("#")) == 0) {
-			nr_tokens = i;
-			tokens[i] = NULL;
-			break;
-		}
+int parse_command(char *command, char *tokens[])
+{
+	char *curr = command;	/* Next character to scan */
+	char *out = command;	/* Where the next dequoted character goes */
+	int nr_tokens = 0;
+
+	while (true) {
+		char *end;
+
+		/* Skip the whitespaces between tokens */
+		while (*curr && isspace((unsigned char)*curr)) curr++;
+		if (!*curr) break;
+
+		/* Remove comments */
+		if (*curr == '#') break;
+
+		tokens[nr_tokens++] = out;
+
+		curr = __scan_token(curr, out, &end);
+		if (!curr) return -1;
+
+		/* Step over the delimiter before it may get overwritten by '\0' */
+		if (*curr) curr++;
+		*end = '\0';
+		out = end + 1;
 	}
+	tokens[nr_tokens] = NULL;
 
 	return nr_tokens;
 }
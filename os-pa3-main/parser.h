@@ -16,10 +16,18 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
-#define MAX_NR_TOKENS	32		/* Maximum length of tokens in a command */
 #define MAX_TOKEN_LEN	128		/* Maximum length of single token */
 #define MAX_COMMAND_LEN	1024	/* Maximum length of assembly string */
 
+/* Maximum number of tokens in a command (including the NULL terminator) */
+#define MAX_NR_TOKENS	(MAX_COMMAND_LEN / 2 + 1)
+
+/**
+ * Split @command into @tokens[] in place. Tokens are separated by whitespaces
+ * and may be quoted with '...' or "..." or escaped with a backslash. A word
+ * starting with # begins a comment. Return the number of tokens, or -1 if a
+ * quote is not closed.
+ */
 int parse_command(char *command, char *tokens[]);
 
 #endif
@@ -0,0 +1,98 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "vm.h"
+#include "frame.h"
+#include "swap.h"
+
+/**
+ * The simulator core in vm.c, shared by its front ends: vm (main.c) and
+ * vmbench. The options are set before init_system()
+ */
+extern bool verbose;
+extern bool print_tlb_result;		/* Also counts the TLB hits and misses */
+extern bool print_swap_stats;
+extern bool print_translation_stats;
+extern bool print_accesses;
+
+extern struct process *current;
+
+extern unsigned int nr_pageframes;
+extern enum frame_allocator frame_allocator;
+extern unsigned int nr_tlb_entries;
+extern unsigned int tlb_ways;
+extern enum tlb_replacement tlb_replacement;
+extern unsigned int nr_swap_slots;
+extern struct replacement_policy *replacement;
+extern unsigned int nr_pwc_entries;
+extern struct translation_costs translation_costs;
+
+extern struct tlb_stats tlb_stats;
+extern struct swap_stats swap_stats;
+extern struct translation_stats translation_stats;
+
+/**
+ * A command compiled from a line of the workload. A workload is compiled
+ * into an array of them at once with -R, and then replayed without
+ * parsing. @arg is the VPN, or the PID to switch to.
+ */
+enum opcode {
+	OP_NONE,		/* Blank line, comment, or broken quote */
+	OP_UNKNOWN,
+	OP_EXIT,
+	OP_SHOW,
+	OP_FRAMES,
+	OP_TLB,
+	OP_HELP,
+	OP_SWITCH,
+	OP_FREE,
+	OP_ACCESS,
+	OP_ALLOC,
+};
+
+struct op {
+	unsigned int arg;
+	unsigned char opcode;
+	unsigned char rw;
+	unsigned char levels;	/* Of the huge page to allocate */
+};
+
+enum opcode compile_command(char *command, struct op *op);
+
+bool run_op(const struct op *op);
+
+/**
+ * Whether the TLB, the frames, the swap and the page-walk cache are set up
+ * within their limits
+ */
+bool check_system(void);
+bool init_system(void);
+void fini_system(void);
+
+void do_simulation(FILE *input);
+void replay_simulation(FILE *input);
+
+bool set_translation_costs(const char *spec);
+
+void show_tlb_stats(void);
+void show_swap_stats(void);
+void show_translation_stats(void);
+
+#endif
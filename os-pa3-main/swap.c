@@ -0,0 +1,376 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "list_head.h"
+#include "frame.h"
+#include "swap.h"
+
+/***********************************************************************
+ * Swap slots
+ *
+ * The free slots are stacked in @__free_slots
+ */
+static unsigned int *__swap_counts;
+static unsigned int *__free_slots;
+static unsigned int __nr_free_slots;
+
+bool init_swap(unsigned int nr_slots)
+{
+	__swap_counts = calloc(nr_slots + 1, sizeof(*__swap_counts));
+	__free_slots = calloc(nr_slots + 1, sizeof(*__free_slots));
+	if (!__swap_counts || !__free_slots)
+		return false;
+
+	/* Hand out the smaller slots first */
+	for (unsigned int i = 0; i < nr_slots; i++) {
+		__free_slots[i] = nr_slots - 1 - i;
+	}
+	__nr_free_slots = nr_slots;
+	return true;
+}
+
+void fini_swap(void)
+{
+	free(__swap_counts);
+	free(__free_slots);
+	__swap_counts = __free_slots = NULL;
+}
+
+unsigned int alloc_swap_slot(void)
+{
+	unsigned int slot;
+
+	if (!__nr_free_slots)
+		return NO_SWAP_SLOT;
+
+	slot = __free_slots[--__nr_free_slots];
+	__swap_counts[slot] = 1;
+	return slot;
+}
+
+void get_swap_slot(unsigned int slot)
+{
+	assert(__swap_counts[slot]);
+	__swap_counts[slot]++;
+}
+
+void put_swap_slot(unsigned int slot)
+{
+	assert(__swap_counts[slot]);
+	if (--__swap_counts[slot] == 0)
+		__free_slots[__nr_free_slots++] = slot;
+}
+
+unsigned int swap_slot_count(unsigned int slot)
+{
+	return __swap_counts[slot];
+}
+
+
+/***********************************************************************
+ * Replacement policies
+ *
+ * Every policy but FIFO sweeps the frames in the PFN order with a hand.
+ * @__in_use tells the frames being tracked.
+ */
+static unsigned int __nr_frames;
+static bool *__in_use;
+static unsigned int __hand;
+
+static bool __init_frames_in_use(unsigned int nr_frames)
+{
+	__nr_frames = nr_frames;
+	__in_use = calloc(nr_frames, sizeof(*__in_use));
+	__hand = 0;
+	return __in_use;
+}
+
+static void __fini_frames_in_use(void)
+{
+	free(__in_use);
+	__in_use = NULL;
+}
+
+static void __advance_hand(void)
+{
+	__hand = (__hand + 1) % __nr_frames;
+}
+
+static unsigned int __take_frame(unsigned int pfn)
+{
+	__in_use[pfn] = false;
+	return pfn;
+}
+
+/**
+ * FIFO evicts the frame mapped the earliest
+ */
+static struct list_head __fifo;
+static struct list_head *__fifo_links;
+
+static bool fifo_init(unsigned int nr_frames)
+{
+	INIT_LIST_HEAD(&__fifo);
+	__fifo_links = calloc(nr_frames, sizeof(*__fifo_links));
+	return __fifo_links;
+}
+
+static void fifo_fini(void)
+{
+	free(__fifo_links);
+	__fifo_links = NULL;
+}
+
+static void fifo_mapped(unsigned int pfn)
+{
+	list_add_tail(__fifo_links + pfn, &__fifo);
+}
+
+static void fifo_unmapped(unsigned int pfn)
+{
+	list_del_init(__fifo_links + pfn);
+}
+
+static unsigned int fifo_victim(void)
+{
+	unsigned int pfn;
+
+	if (list_empty(&__fifo))
+		return NO_FRAME;
+
+	pfn = __fifo.next - __fifo_links;
+	fifo_unmapped(pfn);
+	return pfn;
+}
+
+static struct replacement_policy fifo_replacement = {
+	.name = "fifo",
+	.description = "The earliest mapped frame",
+	.init = fifo_init,
+	.fini = fifo_fini,
+	.mapped = fifo_mapped,
+	.unmapped = fifo_unmapped,
+	.victim = fifo_victim,
+};
+
+/**
+ * Clock gives a second chance to the frames referenced since the hand
+ * passed them last time
+ */
+static void clock_mapped(unsigned int pfn)
+{
+	__in_use[pfn] = true;
+}
+
+static void clock_unmapped(unsigned int pfn)
+{
+	__in_use[pfn] = false;
+}
+
+static unsigned int clock_victim(void)
+{
+	/* Two rounds clear all the referenced bits on the way */
+	for (unsigned int i = 0; i < __nr_frames * 2; i++, __advance_hand()) {
+		if (!__in_use[__hand] || frame_referenced(__hand))
+			continue;
+
+		return __take_frame(__hand);
+	}
+	return NO_FRAME;
+}
+
+static struct replacement_policy clock_replacement = {
+	.name = "clock",
+	.description = "Second chance to the referenced frames",
+	.init = __init_frames_in_use,
+	.fini = __fini_frames_in_use,
+	.mapped = clock_mapped,
+	.unmapped = clock_unmapped,
+	.victim = clock_victim,
+};
+
+/**
+ * LRU approximated by aging. Each frame has an 8-bit age, which is shifted
+ * right with the referenced bit coming in at the top whenever the hand
+ * passes the frame. The hand ages LRU_SWEEP frames per eviction rather than
+ * all of them, so an eviction looks up the referenced bits of a bounded
+ * number of frames. The frames are filed in buckets by the top bit of their
+ * age, and the victim is the earliest filed in the lowest bucket. That is
+ * the least recently used, more or less.
+ */
+#define LRU_AGE_BITS	8
+#define LRU_SWEEP		8
+
+static unsigned char *__ages;
+static struct list_head __lru_buckets[LRU_AGE_BITS + 1];	/* 0 for age 0 */
+static struct list_head *__lru_links;
+
+static bool lru_init(unsigned int nr_frames)
+{
+	for (unsigned int i = 0; i <= LRU_AGE_BITS; i++) {
+		INIT_LIST_HEAD(__lru_buckets + i);
+	}
+
+	__ages = calloc(nr_frames, sizeof(*__ages));
+	__lru_links = calloc(nr_frames, sizeof(*__lru_links));
+	if (!__ages || !__lru_links)
+		return false;
+
+	for (unsigned int pfn = 0; pfn < nr_frames; pfn++) {
+		INIT_LIST_HEAD(__lru_links + pfn);
+	}
+	return __init_frames_in_use(nr_frames);
+}
+
+static void lru_fini(void)
+{
+	free(__ages);
+	__ages = NULL;
+	free(__lru_links);
+	__lru_links = NULL;
+	__fini_frames_in_use();
+}
+
+static void __lru_file(unsigned int pfn)
+{
+	unsigned int bucket = __ages[pfn] ? 32 - __builtin_clz(__ages[pfn]) : 0;
+
+	list_move_tail(__lru_links + pfn, __lru_buckets + bucket);
+}
+
+static void lru_mapped(unsigned int pfn)
+{
+	__in_use[pfn] = true;
+	__ages[pfn] = 0x80;
+	__lru_file(pfn);
+}
+
+static void lru_unmapped(unsigned int pfn)
+{
+	__in_use[pfn] = false;
+	list_del_init(__lru_links + pfn);
+}
+
+static unsigned int lru_victim(void)
+{
+	for (unsigned int i = 0; i < LRU_SWEEP && i < __nr_frames; i++, __advance_hand()) {
+		if (!__in_use[__hand])
+			continue;
+
+		__ages[__hand] = (__ages[__hand] >> 1) | (frame_referenced(__hand) ? 0x80 : 0);
+		__lru_file(__hand);
+	}
+
+	for (unsigned int i = 0; i <= LRU_AGE_BITS; i++) {
+		unsigned int pfn;
+
+		if (list_empty(__lru_buckets + i))
+			continue;
+
+		pfn = __lru_buckets[i].next - __lru_links;
+		list_del_init(__lru_links + pfn);
+		return __take_frame(pfn);
+	}
+	return NO_FRAME;
+}
+
+static struct replacement_policy lru_replacement = {
+	.name = "lru",
+	.description = "LRU approximated by aging the referenced bits",
+	.init = lru_init,
+	.fini = lru_fini,
+	.mapped = lru_mapped,
+	.unmapped = lru_unmapped,
+	.victim = lru_victim,
+};
+
+/**
+ * Working set by WSClock. The hand stamps the referenced frames with the
+ * current time, and takes the first frame out of the working set, that is,
+ * not referenced for DEFAULT_WS_WINDOW accesses. When all frames are in the
+ * working set, the one referenced the longest ago goes.
+ */
+static unsigned long *__last_used;
+
+static bool ws_init(unsigned int nr_frames)
+{
+	__last_used = calloc(nr_frames, sizeof(*__last_used));
+	return __last_used && __init_frames_in_use(nr_frames);
+}
+
+static void ws_fini(void)
+{
+	free(__last_used);
+	__last_used = NULL;
+	__fini_frames_in_use();
+}
+
+static void ws_mapped(unsigned int pfn)
+{
+	__in_use[pfn] = true;
+	__last_used[pfn] = nr_accesses;
+}
+
+static unsigned int ws_victim(void)
+{
+	unsigned int oldest = NO_FRAME;
+
+	for (unsigned int i = 0; i < __nr_frames; i++, __advance_hand()) {
+		if (!__in_use[__hand])
+			continue;
+
+		if (frame_referenced(__hand)) {
+			__last_used[__hand] = nr_accesses;
+		} else if (nr_accesses - __last_used[__hand] > DEFAULT_WS_WINDOW) {
+			return __take_frame(__hand);
+		}
+
+		if (oldest == NO_FRAME || __last_used[__hand] < __last_used[oldest])
+			oldest = __hand;
+	}
+	return oldest == NO_FRAME ? NO_FRAME : __take_frame(oldest);
+}
+
+static struct replacement_policy ws_replacement = {
+	.name = "ws",
+	.description = "Out of the working set by WSClock",
+	.init = ws_init,
+	.fini = ws_fini,
+	.mapped = ws_mapped,
+	.unmapped = clock_unmapped,
+	.victim = ws_victim,
+};
+
+struct replacement_policy *replacement_policies[] = {
+	&fifo_replacement,
+	&clock_replacement,
+	&lru_replacement,
+	&ws_replacement,
+	NULL,
+};
+
+struct replacement_policy *lookup_replacement(const char *name)
+{
+	for (struct replacement_policy **r = replacement_policies; *r; r++) {
+		if (!strcmp((*r)->name, name))
+			return *r;
+	}
+	return NULL;
+}
@@ -0,0 +1,84 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+#ifndef __SWAP_H__
+#define __SWAP_H__
+
+#include <stdbool.h>
+
+/**
+ * Swap backend and page replacement
+ *
+ * Evicted pages go to one of the swap slots. A slot is counted for each PTE
+ * pointing to it, and for the frame holding a clean copy of it, so that a
+ * clean frame can be evicted again without writing it out.
+ */
+#define NO_SWAP_SLOT	((unsigned int)-1)
+
+bool init_swap(unsigned int nr_slots);
+void fini_swap(void);
+
+unsigned int alloc_swap_slot(void);
+void get_swap_slot(unsigned int slot);
+void put_swap_slot(unsigned int slot);
+unsigned int swap_slot_count(unsigned int slot);
+
+/**
+ * A replacement policy tracks the frames in use from mapped() to unmapped()
+ * or until victim() picks it to evict, which stops tracking it as well.
+ * The policies learn the use of the frames through frame_referenced().
+ */
+struct replacement_policy {
+	const char *name;
+	const char *description;
+
+	bool (*init)(unsigned int nr_frames);
+	void (*fini)(void);
+	void (*mapped)(unsigned int pfn);
+	void (*unmapped)(unsigned int pfn);
+	unsigned int (*victim)(void);
+};
+
+extern struct replacement_policy *replacement_policies[];
+struct replacement_policy *lookup_replacement(const char *name);
+
+/**
+ * Whether any PTE mapping @pfn is referenced since the last call, clearing
+ * the referenced bits. Provided by the paging code
+ */
+bool frame_referenced(unsigned int pfn);
+
+/**
+ * Virtual time in the number of memory accesses. Provided by the framework
+ */
+extern unsigned long nr_accesses;
+
+/**
+ * Frames not referenced for more than this many accesses are out of the
+ * working set
+ */
+#define DEFAULT_WS_WINDOW	32
+
+/**
+ * Paging counters of a run, printed at exit with -p
+ */
+struct swap_stats {
+	unsigned long nr_minor_faults;	/* Resolved without I/O */
+	unsigned long nr_major_faults;	/* Read the page from the swap */
+	unsigned long nr_swap_ins;
+	unsigned long nr_swap_outs;
+	unsigned long nr_evictions;		/* Frames reclaimed, written out or not */
+};
+
+#endif
@@ -18,7 +18,6 @@
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
-#include <getopt.h>
 #include <ctype.h>
 #include <inttypes.h>
 #include <strings.h>
@@ -27,19 +26,28 @@
 
 #include "list_head.h"
 #include "vm.h"
+#include "frame.h"
+#include "swap.h"
+#include "pagetable.h"
+#include "sim.h"
 
-static bool verbose = true;
+bool verbose = true;
 
-static bool print_tlb_result = false;
+bool print_tlb_result = false;
+bool print_swap_stats = false;
+bool print_translation_stats = false;
+bool print_accesses = true;
 
 /**
  * Initial process
  */
 static struct process init = {
 	.pid = 0,
+	.asid = 0,
+	.asid_generation = 1,
 	.list = LIST_HEAD_INIT(init.list),
 	.pagetable = {
-		.pdes = { NULL },
+		.root = NULL,
 	},
 };
 
@@ -60,9 +68,11 @@ LIST_HEAD(processes);
 struct pagetable *ptbr = NULL;
 
 /**
- * Map count for each page frame
+ * Map count for each of the @nr_pageframes page frames
  */
-unsigned int mapcounts[NR_PAGEFRAMES] = { 0 };
+unsigned int nr_pageframes = NR_PAGEFRAMES;
+unsigned int *mapcounts = NULL;
+enum frame_allocator frame_allocator = FRAME_BITMAP;
 
 /**
  * TLB of the system
@@ -71,13 +81,109 @@ struct tlb_entry tlb[NR_TLB_ENTRIES] = {
 	{false, 0, 0},
 };
 
+/**
+ * TLB geometry, replacement policy, and counters
+ */
+unsigned int nr_tlb_entries = NR_TLB_ENTRIES;
+unsigned int tlb_ways = DEFAULT_TLB_WAYS;
+enum tlb_replacement tlb_replacement = TLB_LRU;
+struct tlb_stats tlb_stats = { 0 };
+
+/**
+ * Swap slots, page replacement policy, and paging counters
+ */
+unsigned int nr_swap_slots = 0;
+struct replacement_policy *replacement = NULL;
+struct swap_stats swap_stats = { 0 };
+unsigned long nr_accesses = 0;
+
+/**
+ * Page-walk cache, and the cost model of the translation
+ */
+unsigned int nr_pwc_entries = 0;
+struct translation_costs translation_costs = {
+	.tlb_hit = DEFAULT_TLB_HIT_CYCLES,
+	.walk_step = DEFAULT_WALK_STEP_CYCLES,
+	.fault = DEFAULT_FAULT_CYCLES,
+};
+struct translation_stats translation_stats = { 0 };
+
 extern unsigned int alloc_page(unsigned int vpn, unsigned int rw);
 extern void free_page(unsigned int vpn);
 extern bool handle_page_fault(unsigned int vpn, unsigned int rw);
+extern bool init_paging(void);
 extern void switch_process(unsigned int pid);
 
 extern bool lookup_tlb(unsigned int vpn, unsigned int rw, unsigned int *pfn);
 extern void insert_tlb(unsigned int vpn, unsigned int rw, unsigned int pfn);
+extern void insert_huge_tlb(unsigned int vpn, unsigned int rw, unsigned int pfn, unsigned int shift);
+extern unsigned int alloc_huge_page(unsigned int vpn, unsigned int rw, unsigned int level);
+
+/**
+ * Walk the current page table as MMU does, starting from the deepest table
+ * in the page-walk cache. Reading an entry of a level is a step, which is
+ * counted in @nr_steps. Otherwise the same as walk_pagetable()
+ */
+static struct pte *__mmu_walk(unsigned int vpn, unsigned int *level, unsigned int *nr_steps)
+{
+	struct pte *table = NULL;
+	unsigned int l = 0;
+
+	if (!ptbr) return NULL;
+
+	if (nr_pwc_entries) {
+		table = lookup_pwc(ptbr, vpn, &l);
+		if (table) {
+			translation_stats.nr_pwc_hits++;
+		} else {
+			translation_stats.nr_pwc_misses++;
+		}
+	}
+	if (!table) {
+		table = ptbr->root;
+		l = 0;
+	}
+
+	for (; table; l++) {
+		struct pte *pte = table + pt_index(vpn, l);
+
+		(*nr_steps)++;
+
+		if (l == leaf_level() || pte_is_leaf(pte)) {
+			*level = l;
+			return pte;
+		}
+
+		if (pte->table && nr_pwc_entries) insert_pwc(ptbr, vpn, l, pte->table);
+		table = pte->table;
+	}
+	return NULL;
+}
+
+/**
+ * The leaf PTE of @vpn in the current page table, NULL if there is no
+ * table for it. The level of the leaf is put in @level if given
+ */
+static struct pte *__walk(unsigned int vpn, unsigned int *level)
+{
+	if (!ptbr) return NULL;
+
+	return walk_pagetable(ptbr, vpn, leaf_level(), false, level);
+}
+
+/**
+ * Set the referenced bit, and the dirty bit for a write, of the PTE that
+ * has just translated @vpn. MMU does so even on TLB hits here
+ */
+static void __mark_pte(unsigned int vpn, unsigned int rw)
+{
+	struct pte *pte = __walk(vpn, NULL);
+
+	if (!pte || !pte->valid) return;
+
+	pte->referenced = true;
+	if (rw & ACCESS_WRITE) pte->dirty = true;
+}
 
 /**
  * __translate()
@@ -91,14 +197,12 @@ extern void insert_tlb(unsigned int vpn, unsigned int rw, unsigned int pfn);
  *   @false if unable to translate. This includes the case when the page access
  *   is for write (indicated in @rw), but @pte->rw indicates it's read-only.
  */
-static bool __translate(unsigned int rw, unsigned int vpn, unsigned int *pfn, bool *from_tlb)
+static bool __translate(unsigned int rw, unsigned int vpn, unsigned int *pfn, bool *from_tlb,
+		unsigned int *nr_steps)
 {
-	int pd_index = vpn / NR_PTES_PER_PAGE;
-	int pte_index = vpn % NR_PTES_PER_PAGE;
-
-	struct pagetable *pt = ptbr;
-	struct pte_directory *pd;
 	struct pte *pte;
+	unsigned int level;
+	unsigned int offset;
 
 	/* Lookup the mapping from TLB */
 	if (print_tlb_result && lookup_tlb(vpn, rw, pfn)) {
@@ -109,15 +213,11 @@ static bool __translate(unsigned int rw, unsigned int vpn, unsigned int *pfn, bo
 	/* Nah, TLB miss */
 	*from_tlb = false;
 
-	/* Page table is invalid */
-	if (!pt) return false;
-
-	pd = pt->pdes[pd_index];
+	/* Walk down the levels. Stop at a huge page on the way */
+	pte = __mmu_walk(vpn, &level, nr_steps);
 
-	/* Page directory does not exist */
-	if (!pd) return false;
-
-	pte = &pd->ptes[pte_index];
+	/* Page table is invalid, or a table on the way does not exist */
+	if (!pte) return false;
 
 	/* PTE is invalid */
 	if (!pte->valid) return false;
@@ -126,16 +226,50 @@ static bool __translate(unsigned int rw, unsigned int vpn, unsigned int *pfn, bo
 	if (rw & ACCESS_WRITE) {
 		if (!(pte->rw & ACCESS_WRITE)) return false;
 	}
-	*pfn = pte->pfn;
+	offset = vpn & ((1U << pt_shifts[level]) - 1);
+	*pfn = pte->pfn + offset;
 
-	/* Insert the mapping into TLB */
+	/* Insert the mapping into TLB. A huge page takes just one entry */
 	if (print_tlb_result) {
-		insert_tlb(vpn, pte->rw, *pfn);
+		if (level == leaf_level()) {
+			insert_tlb(vpn, pte->rw, *pfn);
+		} else {
+			insert_huge_tlb(vpn - offset, pte->rw, pte->pfn, pt_shifts[level]);
+		}
 	}
 
 	return true;
 }
 
+static void __charge_translation(bool from_tlb, unsigned int nr_steps)
+{
+	struct translation_stats *ts = &translation_stats;
+
+	ts->nr_translations++;
+	if (print_tlb_result) ts->cycles += translation_costs.tlb_hit;
+	if (from_tlb) return;
+
+	ts->nr_walks++;
+	ts->nr_walk_steps += nr_steps;
+	ts->cycles += (unsigned long)nr_steps * translation_costs.walk_step;
+}
+
+static void __charge_fault(void)
+{
+	translation_stats.nr_faults++;
+	translation_stats.cycles += translation_costs.fault;
+}
+
+/* Like the MMU, the page table covers only nr_vpns() pages */
+static bool __vpn_in_range(unsigned int vpn)
+{
+	if (vpn < nr_vpns())
+		return true;
+
+	fprintf(stderr, "%u is out of the address space\n", vpn);
+	return false;
+}
+
 /**
  * __access_memory
  *
@@ -156,33 +290,54 @@ static bool __access_memory(unsigned int vpn, unsigned int rw)
 	/* Cannot read nor write at the same time!! */
 	assert((rw & ACCESS_READ) ^ (rw & ACCESS_WRITE));
 
-	/**
-	 * We have NR_PDES_PER_PAGE entries in the outer tables and
-	 * NR_PTES_PER_PAGE in inner tables.
-	 */
-	assert(vpn < NR_PDES_PER_PAGE * NR_PTES_PER_PAGE);
+	nr_accesses++;
+
+	if (!__vpn_in_range(vpn)) {
+		ret = false;
+		goto out;
+	}
 
 	do {
 		bool from_tlb;
+		bool translated;
+		unsigned int nr_steps = 0;
+
 		/* Ask MMU to translate VPN */
-		if (__translate(rw, vpn, &pfn, &from_tlb)) {
+		translated = __translate(rw, vpn, &pfn, &from_tlb, &nr_steps);
+		__charge_translation(from_tlb, nr_steps);
+		if (print_tlb_result) {
+			if (from_tlb) {
+				tlb_stats.nr_hits++;
+			} else {
+				tlb_stats.nr_misses++;
+			}
+		}
+
+		if (translated) {
 			/* Success on address translation */
-			if (print_tlb_result) {
-				fprintf(stderr, "%c |", from_tlb ? 'o' : 'x');
+			if (print_accesses) {
+				if (print_tlb_result) {
+					fprintf(stderr, "%c |", from_tlb ? 'o' : 'x');
+				}
+				fprintf(stderr, " %3u --> %-3u\n", vpn, pfn);
 			}
-			fprintf(stderr, " %3u --> %-3u\n", vpn, pfn);
+			__mark_pte(vpn, rw);
 			return true;
 		}
 
 		/**
 		 * Failed to translate the address. So, call OS through the page fault
 		 * and restart the translation if the fault is successfully handled.
-		 * Count the number of retries to prevent buggy translation.
+		 * Count the number of retries to prevent buggy translation. A write
+		 * to a swapped copy-on-write page faults twice, to swap it in and to
+		 * copy it.
 		 */
 		nr_retries++;
-	} while ((ret = handle_page_fault(vpn, rw)) == true && nr_retries < 2);
+		__charge_fault();
+	} while ((ret = handle_page_fault(vpn, rw)) == true && nr_retries < 3);
 
-	if (ret == false) {
+out:
+	if (ret == false && print_accesses) {
 		fprintf(stderr, "Unable to access %u\n", vpn);
 	}
 
@@ -209,15 +364,25 @@ static bool __alloc_page(unsigned int vpn, unsigned int rw)
 {
 	unsigned int pfn;
 	bool from_tlb;
+	unsigned int nr_steps = 0;
+	struct pte *pte;
 
 	assert(rw);
 	assert(rw & ACCESS_READ);
 
+	if (!__vpn_in_range(vpn))
+		return false;
+	pte = __walk(vpn, NULL);
+
 	/* Check whether the requested VPN is already allocated */
-	if (__translate(ACCESS_READ, vpn, &pfn, &from_tlb)) {
+	if (__translate(ACCESS_READ, vpn, &pfn, &from_tlb, &nr_steps)) {
 		fprintf(stderr, "%u is already allocated to %u\n", vpn, pfn);
 		return false;
 	}
+	if (pte && pte->swapped) {
+		fprintf(stderr, "%u is already allocated to swap slot %u\n", vpn, pte->pfn);
+		return false;
+	}
 
 	pfn = alloc_page(vpn, rw);
 	if (pfn == -1) {
@@ -229,12 +394,64 @@ static bool __alloc_page(unsigned int vpn, unsigned int rw)
 	return true;
 }
 
+/**
+ * Allocate a huge page mapped at @levels above the last level, covering
+ * @vpn. The whole range should be free
+ */
+static bool __alloc_huge_page(unsigned int vpn, unsigned int rw, unsigned int levels)
+{
+	unsigned int level = leaf_level() - levels;
+	unsigned int pfn;
+	struct pte *pte;
+
+	assert(rw & ACCESS_READ);
+
+	if (!__vpn_in_range(vpn))
+		return false;
+
+	if (levels < 1 || levels > leaf_level()) {
+		fprintf(stderr, "No huge page %u levels up\n", levels);
+		return false;
+	}
+
+	vpn &= ~((1U << pt_shifts[level]) - 1);
+
+	if (ptbr) {
+		pte = walk_pagetable(ptbr, vpn, level, false, NULL);
+		if (pte && (pte_is_leaf(pte) || pte->table)) {
+			fprintf(stderr, "%u is already allocated\n", vpn);
+			return false;
+		}
+	}
+
+	pfn = alloc_huge_page(vpn, rw, level);
+	if (pfn == -1) {
+		fprintf(stderr, "memory is full\n");
+		return false;
+	}
+	fprintf(stderr, "alloc %3u --> %-3u (%u pages)\n", vpn, pfn, 1U << pt_shifts[level]);
+
+	return true;
+}
+
 static bool __free_page(unsigned int vpn)
 {
 	unsigned int pfn;
 	bool from_tlb;
+	unsigned int nr_steps = 0;
+	struct pte *pte;
+
+	if (!__vpn_in_range(vpn))
+		return false;
+	pte = __walk(vpn, NULL);
+
+	if (pte && pte->swapped) {
+		fprintf(stderr, "free %u (swap slot %u)\n", vpn, pte->pfn);
+		free_page(vpn);
+		return true;
+	}
 
-	if (!__translate(ACCESS_READ, vpn, &pfn, &from_tlb)) {
+	if (!__translate(ACCESS_READ, vpn, &pfn, &from_tlb, &nr_steps)) {
 		fprintf(stderr, "%u is not allocated\n", vpn);
 		return false;
 	}
@@ -244,40 +461,101 @@ static bool __free_page(unsigned int vpn)
 	return true;
 }
 
-static void __init_system(void)
+static bool __power_of_two(unsigned int n)
+{
+	return n && !(n & (n - 1));
+}
+
+bool check_system(void)
+{
+	return __power_of_two(nr_tlb_entries) && nr_tlb_entries <= NR_TLB_ENTRIES &&
+			__power_of_two(tlb_ways) && tlb_ways <= nr_tlb_entries &&
+			(int)nr_pageframes >= 1 && (int)nr_swap_slots >= 0 && (int)nr_pwc_entries >= 0;
+}
+
+bool init_system(void)
 {
+	mapcounts = calloc(nr_pageframes, sizeof(*mapcounts));
+	if (!mapcounts || !init_frames(nr_pageframes, frame_allocator)) {
+		fprintf(stderr, "Unable to allocate %u page frames\n", nr_pageframes);
+		return false;
+	}
+
+	if (!init_pwc(nr_pwc_entries)) {
+		fprintf(stderr, "Unable to allocate %u page-walk cache entries\n", nr_pwc_entries);
+		return false;
+	}
+
+	if (!init_swap(nr_swap_slots) || !replacement->init(nr_pageframes) || !init_paging()) {
+		fprintf(stderr, "Unable to allocate %u swap slots\n", nr_swap_slots);
+		return false;
+	}
+
 	ptbr = &init.pagetable;
+	return true;
+}
+
+void fini_system(void)
+{
+	free(mapcounts);
+	fini_frames();
+	replacement->fini();
+	fini_swap();
+	fini_pwc();
 }
 
 static void __show_pageframes(void)
 {
-	for (unsigned int i = 0; i < NR_PAGEFRAMES; i++) {
+	for (unsigned int i = 0; i < nr_pageframes; i++) {
 		if (!mapcounts[i]) continue;
 		fprintf(stderr, "%3u: %d\n", i, mapcounts[i]);
 	}
 	fprintf(stderr, "\n");
 }
 
-static void __show_pagetable(void)
+/**
+ * Show the entries of @table at @level, and the tables below it. The index
+ * of each level leads an entry, and a huge page has -- for the levels it
+ * covers.
+ */
+static void __show_table(struct pte *table, unsigned int level, unsigned int *indices)
 {
-	fprintf(stderr, "\n*** PID %u ***\n", current->pid);
+	for (unsigned int i = 0; i < (1U << pt_bits[level]); i++) {
+		struct pte *pte = table + i;
 
-	for (int i = 0; i < NR_PDES_PER_PAGE; i++) {
-		struct pte_directory *pd = current->pagetable.pdes[i];
+		indices[level] = i;
 
-		if (!pd) continue;
+		if (level < leaf_level() && !pte_is_leaf(pte)) {
+			if (pte->table) __show_table(pte->table, level + 1, indices);
+			continue;
+		}
 
-		for (int j = 0; j < NR_PTES_PER_PAGE; j++) {
-			struct pte *pte = &pd->ptes[j];
+		if (!verbose && !pte->valid) continue;
 
-			if (!verbose && !pte->valid) continue;
-			fprintf(stderr, "%02d:%02d | %c %c%c | %-3d\n", i, j,
-				pte->valid ? 'v' : ' ',
-				pte->valid ? (pte->rw & ACCESS_READ ? 'r' : ' ') : ' ',
-				pte->rw & ACCESS_WRITE ? 'w' : ' ',
-				pte->pfn);
+		for (unsigned int l = 0; l < nr_pt_levels; l++) {
+			if (l <= level) {
+				fprintf(stderr, l ? ":%02u" : "%02u", indices[l]);
+			} else {
+				fprintf(stderr, ":--");
+			}
 		}
-		printf("\n");
+		fprintf(stderr, " | %c %c%c | %-3d\n",
+			pte->valid ? 'v' : (pte->swapped ? 's' : ' '),
+			pte->valid || pte->swapped ? (pte->rw & ACCESS_READ ? 'r' : ' ') : ' ',
+			pte->rw & ACCESS_WRITE ? 'w' : ' ',
+			pte->pfn);
+	}
+	if (level == leaf_level()) printf("\n");
+}
+
+static void __show_pagetable(void)
+{
+	unsigned int indices[MAX_PT_LEVELS];
+
+	fprintf(stderr, "\n*** PID %u ***\n", current->pid);
+
+	if (current->pagetable.root) {
+		__show_table(current->pagetable.root, 0, indices);
 	}
 }
 
@@ -286,12 +564,15 @@ static void __show_tlb(void)
 	for (int i = 0; i < sizeof(tlb) / sizeof(*tlb); i++) {
 		struct tlb_entry *t = tlb + i;
 
-		if (!t->valid) continue;
+		/* Entries of the other address spaces are not visible */
+		if (!t->valid || t->asid != current->asid) continue;
 
-		fprintf(stderr, "%c%c | %3d -> %-3d\n",
+		fprintf(stderr, "%c%c | %3d -> %-3d",
 				t->rw & ACCESS_READ ? 'r' : ' ',
 				t->rw & ACCESS_WRITE ? 'w' : ' ',
 				t->vpn, t->pfn);
+		if (t->shift) fprintf(stderr, " (%u pages)", 1U << t->shift);
+		fprintf(stderr, "\n");
 	}
 }
 
@@ -307,6 +588,8 @@ static void __print_help(void)
 	printf("  tlb          : Show TLB entries\n");
 	printf("\n");
 	printf("  alloc [vpn] r|w  : Allocate a page according to the rw flag\n");
+	printf("  alloc [vpn] r|w [levels]\n");
+	printf("                   : Allocate a huge page mapped @levels above the last level\n");
 	printf("  free [vpn]       : Deallocate the page at VPN @vpn\n");
 	printf("  access [vpn] r|w : Access VPN @vpn for read or write\n");
 	printf("  read [vpn]       : Equivalent to access @vpn r\n");
@@ -320,129 +603,223 @@ static bool strmatch(char * const str, const char *expect)
 			(strncmp(str, expect, strlen(expect)) == 0);
 }
 
-static void __do_simulation(FILE *input)
+static bool __is_command(char * const token, const char *name, const char *alias)
 {
-	char command[MAX_COMMAND_LEN] = { 0 };
+	return strmatch(token, name) || (alias && strmatch(token, alias));
+}
 
-	__init_system();
+enum opcode compile_command(char *command, struct op *op)
+{
+	char *tokens[MAX_NR_TOKENS];
+	int nr_tokens = 0;
 
-	while (fgets(command, sizeof(command), input)) {
-		char *tokens[MAX_NR_TOKENS] = { NULL };
-		int nr_tokens = 0;
+	/* Make the command lowercase */
+	for (char *c = command; *c; c++) {
+		*c = tolower((unsigned char)*c);
+	}
+
+	nr_tokens = parse_command(command, tokens);
 
-		/* Make the command lowercase */
-		for (size_t i = 0; i < strlen(command); i++) {
-			command[i] = tolower(command[i]);
+	if (nr_tokens < 0) {
+		printf("Unterminated quote\n");
+		return op->opcode = OP_NONE;
+	}
+	if (nr_tokens == 0) return op->opcode = OP_NONE;
+
+	op->opcode = OP_UNKNOWN;
+	op->arg = nr_tokens > 1 ? strtoimax(tokens[1], NULL, 0) : 0;
+	op->rw = nr_tokens > 2 ? __make_rwflag(tokens[2]) : 0;
+	op->levels = nr_tokens > 3 ? strtoimax(tokens[3], NULL, 0) : 0;
+
+	switch (nr_tokens) {
+	case 1:
+		if (__is_command(tokens[0], "exit", NULL)) {
+			op->opcode = OP_EXIT;
+		} else if (__is_command(tokens[0], "show", NULL)) {
+			op->opcode = OP_SHOW;
+		} else if (__is_command(tokens[0], "frames", NULL)) {
+			op->opcode = OP_FRAMES;
+		} else if (__is_command(tokens[0], "tlb", NULL)) {
+			op->opcode = OP_TLB;
+		} else if (__is_command(tokens[0], "help", "?")) {
+			op->opcode = OP_HELP;
+		}
+		break;
+	case 2:
+		if (__is_command(tokens[0], "switch", "s")) {
+			op->opcode = OP_SWITCH;
+		} else if (__is_command(tokens[0], "free", "f")) {
+			op->opcode = OP_FREE;
+		} else if (__is_command(tokens[0], "read", "r")) {
+			op->opcode = OP_ACCESS;
+			op->rw = ACCESS_READ;
+		} else if (__is_command(tokens[0], "write", "w")) {
+			op->opcode = OP_ACCESS;
+			op->rw = ACCESS_WRITE;
+		}
+		break;
+	case 3:
+	case 4:
+		if (__is_command(tokens[0], "alloc", "a")) {
+			op->opcode = OP_ALLOC;
+		} else if (nr_tokens == 3 && __is_command(tokens[0], "access", NULL)) {
+			op->opcode = OP_ACCESS;
 		}
+		break;
+	default:
+		assert(!"Unknown command in trace");
+	}
+
+	if (op->opcode == OP_UNKNOWN) printf("Unknown command %s\n", tokens[0]);
+	return op->opcode;
+}
 
-		nr_tokens = parse_command(command, tokens);
+/**
+ * Run @op. Return false to stop the simulation
+ */
+bool run_op(const struct op *op)
+{
+	switch (op->opcode) {
+	case OP_EXIT:
+		return false;
+	case OP_SHOW:
+		__show_pagetable();
+		break;
+	case OP_FRAMES:
+		__show_pageframes();
+		break;
+	case OP_TLB:
+		__show_tlb();
+		break;
+	case OP_HELP:
+		__print_help();
+		break;
+	case OP_SWITCH:
+		switch_process(op->arg);
+		break;
+	case OP_FREE:
+		__free_page(op->arg);
+		break;
+	case OP_ACCESS:
+		__access_memory(op->arg, op->rw);
+		break;
+	case OP_ALLOC:
+		if (op->levels) return __alloc_huge_page(op->arg, op->rw, op->levels);
+		return __alloc_page(op->arg, op->rw);
+	case OP_NONE:
+	case OP_UNKNOWN:
+		break;
+	}
+	return true;
+}
 
-		if (nr_tokens == 0) continue;
+void do_simulation(FILE *input)
+{
+	char command[MAX_COMMAND_LEN] = { 0 };
 
-		if (nr_tokens == 1) {
-			if (strmatch(tokens[0], "exit")) break;
-			if (strmatch(tokens[0], "show")) {
-				__show_pagetable();
-			} else if (strmatch(tokens[0], "frames")) {
-				__show_pageframes();
-			} else if (strmatch(tokens[0], "tlb")) {
-				__show_tlb();
-			} else if (strmatch(tokens[0], "help") || strmatch(tokens[0], "?")) {
-				__print_help();
-			} else {
-				printf("Unknown command %s\n", tokens[0]);
-			}
-		} else if (nr_tokens == 2) {
-			unsigned int arg = strtoimax(tokens[1], NULL, 0);
-
-			if (strmatch(tokens[0], "switch") || strmatch(tokens[0], "s")) {
-				switch_process(arg);
-			} else if (strmatch(tokens[0], "free") || strmatch(tokens[0], "f")) {
-				__free_page(arg);
-			} else if (strmatch(tokens[0], "read") || strmatch(tokens[0], "r")) {
-				__access_memory(arg, ACCESS_READ);
-			} else if (strmatch(tokens[0], "write") || strmatch(tokens[0], "w")) {
-				__access_memory(arg, ACCESS_WRITE);
-			} else {
-				printf("Unknown command %s\n", tokens[0]);
-			}
-		} else if (nr_tokens == 3) {
-			unsigned int vpn = strtoimax(tokens[1], NULL, 0);
-			unsigned int rw = __make_rwflag(tokens[2]);
-
-			if (strmatch(tokens[0], "alloc") || strmatch(tokens[0], "a")) {
-				if (!__alloc_page(vpn, rw)) break;
-			} else if (strmatch(tokens[0], "access")) {
-				__access_memory(vpn, rw);
-			} else {
-				printf("Unknown command %s\n", tokens[0]);
-			}
-		} else {
-			assert(!"Unknown command in trace");
-		}
+	if (!init_system()) return;
+
+	while (fgets(command, sizeof(command), input)) {
+		struct op op;
+
+		if (compile_command(command, &op) == OP_NONE) continue;
+		if (!run_op(&op)) break;
 
 		if (verbose) printf("%d >> ", current->pid);
 	}
 }
 
-static void __print_usage(const char * name)
+/**
+ * Compile the whole workload first, and replay it. The results are
+ * buffered rather than written line by line
+ */
+void replay_simulation(FILE *input)
 {
-	printf("Usage: %s {-q} {-f [workload file]}\n", name);
-	printf("\n");
-	printf("  -t: Show TLB result\n");
-	printf("  -q: Run quietly\n\n");
-}
+	char command[MAX_COMMAND_LEN] = { 0 };
+	struct op *ops = NULL;
+	size_t nr_ops = 0;
+	size_t nr_slots = 0;
 
-int main(int argc, char * argv[])
-{
-	int opt;
-	FILE *input = stdin;
-
-	while ((opt = getopt(argc, argv, "qht")) != -1) {
-		switch (opt) {
-		case 'q':
-			verbose = false;
-			break;
-		case 't':
-			print_tlb_result = true;
-			break;
-		case 'h':
-		default:
-			__print_usage(argv[0]);
-			return EXIT_FAILURE;
+	while (fgets(command, sizeof(command), input)) {
+		enum opcode opcode;
+
+		if (nr_ops == nr_slots) {
+			nr_slots = nr_slots ? nr_slots * 2 : 4096;
+			ops = realloc(ops, sizeof(*ops) * nr_slots);
+			if (!ops) {
+				fprintf(stderr, "Unable to compile the workload\n");
+				return;
+			}
 		}
-	}
 
-	if (verbose && !argv[optind]) {
-		printf("*******************************************************\n");
-		printf("            V M     S I M U L A T O R\n");
-		printf("\n");
-		printf("                                   >> 2024 Spring <<\n");
-		printf("\n");
-		printf("********************************************************\n");
+		opcode = compile_command(command, ops + nr_ops);
+		if (opcode == OP_NONE || opcode == OP_UNKNOWN) continue;
+		if (opcode == OP_EXIT) break;
+		nr_ops++;
 	}
 
-	if (argv[optind]) {
-		if (verbose) printf("Use file \"%s\" for input.\n", argv[optind]);
+	if (init_system()) {
+		setvbuf(stderr, NULL, _IOFBF, 1 << 16);
 
-		input = fopen(argv[optind], "r");
-		if (!input) {
-			fprintf(stderr, "No input file %s\n", argv[optind]);
-			return EXIT_FAILURE;
+		for (size_t i = 0; i < nr_ops; i++) {
+			if (!run_op(ops + i)) break;
 		}
-		verbose = false;
-	} else {
-		if (verbose) printf("Use stdin for input.\n");
+		fflush(stderr);
 	}
+	free(ops);
+}
 
-	if (verbose) {
-		printf("Type 'help' or '?' for help.\n\n");
-		printf("%d >> ", current->pid);
+void show_tlb_stats(void)
+{
+	unsigned long nr_lookups = tlb_stats.nr_hits + tlb_stats.nr_misses;
+
+	fprintf(stderr, "\nTLB: %u entries, %u-way, %s\n", nr_tlb_entries, tlb_ways,
+			tlb_replacement == TLB_CLOCK ? "clock" : "LRU");
+	fprintf(stderr, "  hits      : %lu (%.2f%%)\n", tlb_stats.nr_hits,
+			nr_lookups ? tlb_stats.nr_hits * 100.0 / nr_lookups : 0.0);
+	fprintf(stderr, "  misses    : %lu\n", tlb_stats.nr_misses);
+	fprintf(stderr, "  evictions : %lu\n", tlb_stats.nr_evictions);
+}
+
+void show_swap_stats(void)
+{
+	fprintf(stderr, "\nPaging: %u frames, %u swap slots, %s\n", nr_pageframes, nr_swap_slots,
+			replacement->name);
+	fprintf(stderr, "  minor faults : %lu\n", swap_stats.nr_minor_faults);
+	fprintf(stderr, "  major faults : %lu\n", swap_stats.nr_major_faults);
+	fprintf(stderr, "  swap ins     : %lu\n", swap_stats.nr_swap_ins);
+	fprintf(stderr, "  swap outs    : %lu\n", swap_stats.nr_swap_outs);
+	fprintf(stderr, "  evictions    : %lu\n", swap_stats.nr_evictions);
+}
+
+void show_translation_stats(void)
+{
+	struct translation_stats *ts = &translation_stats;
+	unsigned long nr_pwc_lookups = ts->nr_pwc_hits + ts->nr_pwc_misses;
+
+	fprintf(stderr, "\nTranslation: %u,%u,%u cycles for TLB hit, walk step, and fault\n",
+			translation_costs.tlb_hit, translation_costs.walk_step, translation_costs.fault);
+	fprintf(stderr, "  translations : %lu\n", ts->nr_translations);
+	fprintf(stderr, "  walks        : %lu (%.2f steps per walk)\n", ts->nr_walks,
+			ts->nr_walks ? (double)ts->nr_walk_steps / ts->nr_walks : 0.0);
+	fprintf(stderr, "  faults       : %lu\n", ts->nr_faults);
+	if (nr_pwc_entries) {
+		fprintf(stderr, "  PWC hits     : %lu (%.2f%%) of %u entries\n", ts->nr_pwc_hits,
+				nr_pwc_lookups ? ts->nr_pwc_hits * 100.0 / nr_pwc_lookups : 0.0,
+				nr_pwc_entries);
 	}
+	fprintf(stderr, "  cycles       : %lu (%.2f per access)\n", ts->cycles,
+			nr_accesses ? (double)ts->cycles / nr_accesses : 0.0);
+}
 
-	__do_simulation(input);
+bool set_translation_costs(const char *spec)
+{
+	struct translation_costs costs;
+	char tail;
 
-	if (input != stdin) fclose(input);
+	if (sscanf(spec, "%u,%u,%u%c", &costs.tlb_hit, &costs.walk_step, &costs.fault, &tail) != 3)
+		return false;
 
-	return EXIT_SUCCESS;
+	translation_costs = costs;
+	return true;
 }
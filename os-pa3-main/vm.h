@@ -17,10 +17,10 @@
 
 #include <stdbool.h>
 
-/* The number of physical page frames of the system */
+/* The default number of physical page frames of the system. See -m */
 #define NR_PAGEFRAMES	128
 
-/* The number of PTEs in a page */
+/* The number of PTEs in a page by default. See -L and pagetable.h */
 #define PTES_PER_PAGE_SHIFT	4
 #define NR_PTES_PER_PAGE    (1 << PTES_PER_PAGE_SHIFT)
 
@@ -33,21 +33,25 @@
 #define ACCESS_WRITE 0x02
 
 /**
- * 2-level page table abstraction
+ * Multi-level page table abstraction. An entry either maps a page, maps a
+ * huge page if not at the last level, or points to the table of the next
+ * level in @table.
  */
 struct pte {
 	bool valid;
 	unsigned int rw;
 	unsigned int pfn;
 	unsigned int private;	/* May use to backup something ;-) */
-};
 
-struct pte_directory {
-	struct pte ptes[NR_PTES_PER_PAGE];
+	bool referenced;		/* Set by MMU on access */
+	bool dirty;				/* Set by MMU on write */
+	bool swapped;			/* Swapped out to the swap slot in @pfn */
+
+	struct pte *table;		/* The table of the next level */
 };
 
 struct pagetable {
-	struct pte_directory *pdes[NR_PDES_PER_PAGE];
+	struct pte *root;		/* The table of level 0 */
 };
 
 
@@ -59,16 +63,76 @@ struct process {
 
 	struct pagetable pagetable;
 
+	unsigned int asid;				/* Address space ID tagging its TLB entries */
+	unsigned long asid_generation;	/* @asid is valid in this generation only */
+
 	struct list_head list;  /* List head to chain processes on the system */
+	struct hlist_node hash;	/* In the process table by @pid */
 };
 
 struct tlb_entry {
 	bool valid;
 	int rw;
+	unsigned int asid;
 	unsigned int vpn;
 	unsigned int pfn;
 	unsigned int private;
+	unsigned int shift;			/* Caches 2^@shift pages from @vpn and @pfn */
+
+	unsigned long last_used;	/* When last used, for the LRU replacement */
+	bool referenced;			/* Used since the last sweep, for the clock */
 };
 
 #define NR_TLB_ENTRIES	(1 << (PTES_PER_PAGE_SHIFT * 2))
+
+/**
+ * The number of ASIDs. When they run out, a new generation starts with the
+ * TLB flushed, and processes get new ASIDs as they run again
+ */
+#define NR_ASIDS		16
+
+/**
+ * The TLB has @nr_tlb_entries of @tlb[] (-s) in sets of @tlb_ways entries
+ * (-w), and replaces an entry in a full set by LRU or by clock (-c)
+ */
+#define DEFAULT_TLB_WAYS	4
+
+enum tlb_replacement {
+	TLB_LRU,
+	TLB_CLOCK,
+};
+
+/**
+ * TLB counters of a run, printed at exit with -t
+ */
+struct tlb_stats {
+	unsigned long nr_hits;
+	unsigned long nr_misses;
+	unsigned long nr_evictions;	/* Valid entries replaced for new ones */
+};
+
+/**
+ * Latencies of the steps of a translation in cycles (-C), and the cost of
+ * a run, printed at exit with -k. A TLB lookup is charged only when the
+ * TLB is simulated (-t)
+ */
+#define DEFAULT_TLB_HIT_CYCLES		1
+#define DEFAULT_WALK_STEP_CYCLES	20
+#define DEFAULT_FAULT_CYCLES		1000
+
+struct translation_costs {
+	unsigned int tlb_hit;
+	unsigned int walk_step;		/* To read an entry of a level */
+	unsigned int fault;
+};
+
+struct translation_stats {
+	unsigned long nr_translations;
+	unsigned long nr_walks;
+	unsigned long nr_walk_steps;
+	unsigned long nr_faults;
+	unsigned long nr_pwc_hits;
+	unsigned long nr_pwc_misses;
+	unsigned long cycles;
+};
 #endif
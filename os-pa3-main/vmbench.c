@@ -0,0 +1,644 @@
+/**********************************************************************
+ * Copyright (c) 2019-2024
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "list_head.h"
+#include "vm.h"
+#include "frame.h"
+#include "pagetable.h"
+#include "sim.h"
+
+/**
+ * Generate large workloads of a few access patterns, and run them against
+ * the simulator core. Each run takes place in a child process of its own,
+ * so that it starts from a fresh system and its footprint is its own. The
+ * workload is generated as compiled ops before the clock starts.
+ */
+struct trace {
+	struct op *ops;
+	size_t nr_ops;
+	size_t nr_slots;
+};
+
+struct workload {
+	const char *name;
+	const char *description;
+	void (*generate)(struct trace *);
+};
+
+struct result {
+	bool ok;
+	unsigned long nr_accesses;
+	double seconds;
+	unsigned long nr_tlb_hits;
+	unsigned long nr_tlb_misses;
+	unsigned long nr_faults;
+	unsigned int nr_frames;		/* In use at the end */
+	long rss;			/* Growth of the peak RSS in KiB */
+};
+
+/* The size of the workloads */
+static unsigned int __nr_pages = 1024;
+static unsigned long __nr_accesses = 1UL << 20;
+static unsigned int __nr_iterations = 5;
+
+/* Each run is made at least this long, up to MAX_ACCESSES accesses */
+static double __min_seconds = 1.0;
+#define MAX_ACCESSES	(1UL << 24)
+
+static uint64_t __rand_state;
+
+static void __seed(uint64_t seed)
+{
+	__rand_state = seed;
+}
+
+/* xorshift64* */
+static uint64_t __rand(void)
+{
+	__rand_state ^= __rand_state >> 12;
+	__rand_state ^= __rand_state << 25;
+	__rand_state ^= __rand_state >> 27;
+	return __rand_state * 2685821657736338717ULL;
+}
+
+static unsigned int __rand_below(unsigned int n)
+{
+	return (__rand() >> 32) % n;
+}
+
+static void __emit(struct trace *t, unsigned char opcode, unsigned int arg, unsigned char rw)
+{
+	struct op *op;
+
+	if (t->nr_ops == t->nr_slots) {
+		t->nr_slots = t->nr_slots ? t->nr_slots * 2 : 4096;
+		t->ops = realloc(t->ops, sizeof(*t->ops) * t->nr_slots);
+		if (!t->ops) {
+			printf("Unable to generate the workload\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	op = t->ops + t->nr_ops++;
+	*op = (struct op) {
+		.arg = arg,
+		.opcode = opcode,
+		.rw = rw,
+	};
+}
+
+/* Allocate all pages for read and write */
+static void __alloc_pages(struct trace *t)
+{
+	for (unsigned int vpn = 0; vpn < __nr_pages; vpn++) {
+		__emit(t, OP_ALLOC, vpn, ACCESS_READ | ACCESS_WRITE);
+	}
+}
+
+/* Every fourth access is a write */
+static void __access(struct trace *t, unsigned long i, unsigned int vpn)
+{
+	__emit(t, OP_ACCESS, vpn, i % 4 == 3 ? ACCESS_WRITE : ACCESS_READ);
+}
+
+/***********************************************************************
+ * Workloads
+ */
+static void generate_sequential(struct trace *t)
+{
+	__alloc_pages(t);
+	for (unsigned long i = 0; i < __nr_accesses; i++) {
+		__access(t, i, i % __nr_pages);
+	}
+}
+
+/* A page of every 16 pages, on to the next page at each wrap-around */
+#define STRIDE	16
+
+static void generate_strided(struct trace *t)
+{
+	__alloc_pages(t);
+	for (unsigned long i = 0; i < __nr_accesses; i++) {
+		unsigned long offset = i * STRIDE;
+
+		__access(t, i, (offset + offset / __nr_pages) % __nr_pages);
+	}
+}
+
+static void generate_random(struct trace *t)
+{
+	__alloc_pages(t);
+	for (unsigned long i = 0; i < __nr_accesses; i++) {
+		__access(t, i, __rand_below(__nr_pages));
+	}
+}
+
+/**
+ * Zipfian over the pages with the skew of YCSB. The ranks are scattered
+ * over the pages so that the hot set does not sit in a few tables
+ */
+#define ZIPF_THETA	0.99
+
+static void generate_zipfian(struct trace *t)
+{
+	double *cdf = malloc(sizeof(*cdf) * __nr_pages);
+	unsigned int *pages = malloc(sizeof(*pages) * __nr_pages);
+	double sum = 0;
+
+	if (!cdf || !pages) {
+		printf("Unable to generate the workload\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (unsigned int i = 0; i < __nr_pages; i++) {
+		sum += 1.0 / pow(i + 1, ZIPF_THETA);
+		cdf[i] = sum;
+		pages[i] = i;
+	}
+	for (unsigned int i = __nr_pages - 1; i > 0; i--) {
+		unsigned int j = __rand_below(i + 1);
+		unsigned int page = pages[i];
+
+		pages[i] = pages[j];
+		pages[j] = page;
+	}
+
+	__alloc_pages(t);
+	for (unsigned long i = 0; i < __nr_accesses; i++) {
+		double u = (__rand() >> 11) * (sum / (1ULL << 53));
+		unsigned int lo = 0, hi = __nr_pages - 1;
+
+		while (lo < hi) {
+			unsigned int mid = (lo + hi) / 2;
+
+			if (cdf[mid] < u) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		__access(t, i, pages[lo]);
+	}
+
+	free(cdf);
+	free(pages);
+}
+
+/**
+ * Init writes all pages and forks @NR_CHILDREN children, each of which
+ * bursts into its address space with a quarter of writes. The writes go to
+ * the first @NR_DIRTY_PAGES pages, which are copied on write in each child.
+ * Then the children take turns at random until the accesses run out.
+ */
+#define NR_CHILDREN	64
+#define NR_DIRTY_PAGES	128
+#define BURST		64
+
+static void __burst(struct trace *t, unsigned long *i)
+{
+	unsigned int nr_dirty = __nr_pages < NR_DIRTY_PAGES ? __nr_pages : NR_DIRTY_PAGES;
+
+	for (unsigned int j = 0; j < BURST && *i < __nr_accesses; j++, (*i)++) {
+		if (*i % 4 == 3) {
+			__emit(t, OP_ACCESS, __rand_below(nr_dirty), ACCESS_WRITE);
+		} else {
+			__emit(t, OP_ACCESS, __rand_below(__nr_pages), ACCESS_READ);
+		}
+	}
+}
+
+static void generate_fork(struct trace *t)
+{
+	unsigned long i = 0;
+
+	__alloc_pages(t);
+	for (unsigned int vpn = 0; vpn < __nr_pages && i < __nr_accesses; vpn++, i++) {
+		__emit(t, OP_ACCESS, vpn, ACCESS_WRITE);
+	}
+
+	for (unsigned int pid = 1; pid <= NR_CHILDREN; pid++) {
+		__emit(t, OP_SWITCH, 0, 0);
+		__emit(t, OP_SWITCH, pid, 0);
+		__burst(t, &i);
+	}
+
+	while (i < __nr_accesses) {
+		__emit(t, OP_SWITCH, 1 + __rand_below(NR_CHILDREN), 0);
+		__burst(t, &i);
+	}
+}
+
+static struct workload __workloads[] = {
+	{ "seq", "Sweep through the pages", generate_sequential },
+	{ "stride", "Sweep through the pages by a stride of 16 pages", generate_strided },
+	{ "random", "Access the pages uniformly at random", generate_random },
+	{ "zipf", "Access a hot set of the pages, Zipfian with theta 0.99", generate_zipfian },
+	{ "fork", "Fork 64 children sharing the pages, copied on write", generate_fork },
+};
+
+#define NR_WORKLOADS	(sizeof(__workloads) / sizeof(*__workloads))
+
+static struct workload *__lookup_workload(const char *name, size_t len)
+{
+	for (unsigned int i = 0; i < NR_WORKLOADS; i++) {
+		if (strlen(__workloads[i].name) == len && !strncmp(__workloads[i].name, name, len))
+			return __workloads + i;
+	}
+	return NULL;
+}
+
+/***********************************************************************
+ * Runs
+ */
+static double __now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long __peak_rss(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+/* In the child. The results of commands are thrown away on stderr */
+static void __run_workload(struct workload *w, struct result *r)
+{
+	struct trace trace = { 0 };
+	unsigned long nr_ops = 0;
+	double started;
+	long rss;
+
+	if (!freopen("/dev/null", "w", stderr))
+		return;
+
+	__seed(0x9e3779b97f4a7c15ULL);
+	w->generate(&trace);
+
+	rss = __peak_rss();
+	if (!init_system())
+		return;
+
+	started = __now();
+	while (nr_ops < trace.nr_ops && run_op(trace.ops + nr_ops)) {
+		nr_ops++;
+	}
+	r->seconds = __now() - started;
+
+	r->ok = nr_ops == trace.nr_ops;
+	r->nr_accesses = nr_accesses;
+	r->nr_tlb_hits = tlb_stats.nr_hits;
+	r->nr_tlb_misses = tlb_stats.nr_misses;
+	r->nr_faults = translation_stats.nr_faults;
+	r->nr_frames = nr_pageframes - nr_free_frames();
+	r->rss = __peak_rss() - rss;
+
+	fini_system();
+	free(trace.ops);
+}
+
+static bool __run(struct workload *w, struct result *r)
+{
+	int fds[2];
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+	if (pipe(fds) < 0 || (pid = fork()) < 0) {
+		fprintf(stderr, "Unable to start %s\n", w->name);
+		return false;
+	}
+
+	if (pid == 0) {
+		struct result result = { 0 };
+
+		close(fds[0]);
+		__run_workload(w, &result);
+		if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fds[1]);
+	if (read(fds[0], r, sizeof(*r)) != sizeof(*r))
+		r->ok = false;
+	close(fds[0]);
+
+	waitpid(pid, &status, 0);
+	return r->ok && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static double __throughput(const struct result *r)
+{
+	return r->seconds > 0 ? r->nr_accesses / r->seconds : 0;
+}
+
+static int __compare_throughput(const void *a, const void *b)
+{
+	double ta = __throughput(a);
+	double tb = __throughput(b);
+
+	if (ta != tb)
+		return ta < tb ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Run @w __nr_iterations times, and put the run of the median throughput
+ * in @median. A first run scales up the accesses so that each run lasts at
+ * least __min_seconds, as shorter runs are too noisy to compare
+ */
+static bool __measure(struct workload *w, struct result *median)
+{
+	unsigned long nr_accesses = __nr_accesses;
+	struct result *results = calloc(__nr_iterations, sizeof(*results));
+	struct result result = { 0 };
+	bool ok = results && __run(w, &result);
+
+	if (ok && result.seconds < __min_seconds) {
+		double scale = result.seconds > 0 ? __min_seconds / result.seconds : MAX_ACCESSES;
+
+		__nr_accesses = fmin(MAX_ACCESSES, ceil(scale * __nr_accesses));
+	}
+
+	for (unsigned int i = 0; ok && i < __nr_iterations; i++) {
+		ok = __run(w, results + i);
+	}
+
+	if (ok) {
+		qsort(results, __nr_iterations, sizeof(*results), __compare_throughput);
+		*median = results[__nr_iterations / 2];
+	}
+
+	__nr_accesses = nr_accesses;
+	free(results);
+	return ok;
+}
+
+/***********************************************************************
+ * Baseline of the throughput, as "workload accesses/s" lines
+ */
+struct baseline {
+	char name[32];
+	double throughput;
+};
+
+static struct baseline __baselines[NR_WORKLOADS];
+static unsigned int __nr_baselines = 0;
+
+static bool __load_baseline(const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	struct baseline b;
+
+	if (!file) {
+		fprintf(stderr, "Unable to open baseline %s\n", filename);
+		return false;
+	}
+
+	while (__nr_baselines < NR_WORKLOADS &&
+			fscanf(file, "%31s %lf", b.name, &b.throughput) == 2) {
+		__baselines[__nr_baselines++] = b;
+	}
+	fclose(file);
+	return true;
+}
+
+static struct baseline *__find_baseline(const char *name)
+{
+	for (unsigned int i = 0; i < __nr_baselines; i++) {
+		if (!strcmp(__baselines[i].name, name))
+			return __baselines + i;
+	}
+	return NULL;
+}
+
+static void __print_usage(char *const name)
+{
+	printf("Usage: %s {-P WORKLOADS} {-N ACCESSES} {-M PAGES} {-i ITERATIONS} {-d SECONDS}\n", name);
+	printf("       {-o FILE} {-b FILE} {-T PERCENT} {simulator options}\n");
+	printf("\n");
+	printf("  -P: Run the workloads of WORKLOADS, a comma-separated list of\n");
+	for (unsigned int i = 0; i < NR_WORKLOADS; i++) {
+		printf("      %-6s: %s\n", __workloads[i].name, __workloads[i].description);
+	}
+	printf("      (default all)\n");
+	printf("  -N: Make at least ACCESSES accesses in each workload (default %lu)\n", __nr_accesses);
+	printf("  -M: Allocate PAGES pages in each workload (default %u)\n", __nr_pages);
+	printf("  -i: Run each workload ITERATIONS times, and report the median (default %u)\n",
+			__nr_iterations);
+	printf("  -d: Make more accesses so that each run takes SECONDS (default %.1f)\n",
+			__min_seconds);
+	printf("  -o: Save the throughput of the workloads to FILE as the baseline\n");
+	printf("  -b: Compare the throughput with the baseline in FILE, and fail when\n");
+	printf("      a workload is slower than it by more than PERCENT\n");
+	printf("  -T: Tolerate PERCENT of drop from the baseline (default 15). Runs of\n");
+	printf("      the same build differ by up to about 10%%, so keep PERCENT above it\n");
+	printf("\n");
+	printf("  The simulator options, as of vm, are\n");
+	printf("  -s SIZE -w WAYS -c -m FRAMES -B -S SLOTS -r POLICY -L BITS -W ENTRIES\n");
+	printf("  The default is -m 16384 -L 8,8 here\n");
+	printf("\n");
+	printf("Each workload reports accesses per second, the TLB hit rate, page faults,\n");
+	printf("the frames in use at the end, and how much the peak RSS grows while\n");
+	printf("simulating.\n");
+	printf("\n");
+}
+
+int main(int argc, char *const argv[])
+{
+	struct workload *workloads[NR_WORKLOADS];
+	unsigned int nr_workloads = 0;
+	const char *selection = NULL;
+	const char *save = NULL;
+	const char *base = NULL;
+	double tolerance = 15;
+	FILE *saved = NULL;
+	bool ok = true;
+	int opt;
+
+	replacement = lookup_replacement("clock");
+	nr_pageframes = 16384;
+	set_pt_geometry("8,8");
+
+	while ((opt = getopt(argc, argv, "P:N:M:i:d:o:b:T:s:w:cm:BS:r:L:W:h")) != -1) {
+		switch (opt) {
+		case 'P':
+			selection = optarg;
+			break;
+		case 'N':
+			__nr_accesses = strtoul(optarg, NULL, 0);
+			break;
+		case 'M':
+			__nr_pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			__nr_iterations = atoi(optarg);
+			break;
+		case 'd':
+			__min_seconds = atof(optarg);
+			break;
+		case 'o':
+			save = optarg;
+			break;
+		case 'b':
+			base = optarg;
+			break;
+		case 'T':
+			tolerance = atof(optarg);
+			break;
+		case 's':
+			nr_tlb_entries = atoi(optarg);
+			break;
+		case 'w':
+			tlb_ways = atoi(optarg);
+			break;
+		case 'c':
+			tlb_replacement = TLB_CLOCK;
+			break;
+		case 'm':
+			nr_pageframes = atoi(optarg);
+			break;
+		case 'B':
+			frame_allocator = FRAME_BUDDY;
+			break;
+		case 'S':
+			nr_swap_slots = atoi(optarg);
+			break;
+		case 'r':
+			replacement = lookup_replacement(optarg);
+			if (!replacement) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'L':
+			if (!set_pt_geometry(optarg)) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'W':
+			nr_pwc_entries = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			__print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!check_system() || !__nr_pages || __nr_pages > nr_vpns() || !__nr_accesses ||
+			(int)__nr_iterations < 1 || __min_seconds < 0 || tolerance < 0 || optind < argc) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (selection) {
+		for (const char *s = selection; *s; ) {
+			size_t len = strcspn(s, ",");
+			struct workload *w = __lookup_workload(s, len);
+
+			if (!w) {
+				fprintf(stderr, "Unknown workload %.*s\n", (int)len, s);
+				return EXIT_FAILURE;
+			}
+			workloads[nr_workloads++] = w;
+			if (nr_workloads == NR_WORKLOADS)
+				break;
+			s += len + !!s[len];
+		}
+	} else {
+		for (unsigned int i = 0; i < NR_WORKLOADS; i++) {
+			workloads[nr_workloads++] = __workloads + i;
+		}
+	}
+
+	if (base && !__load_baseline(base)) {
+		return EXIT_FAILURE;
+	}
+	if (save && !(saved = fopen(save, "w"))) {
+		fprintf(stderr, "Unable to save the baseline to %s\n", save);
+		return EXIT_FAILURE;
+	}
+
+	/* Counts the TLB hits without printing each access */
+	print_tlb_result = true;
+	print_accesses = false;
+
+	printf("%-8s  %10s  %8s  %12s  %8s  %10s  %8s  %10s%s\n", "workload", "accesses",
+	       "seconds", "accesses/s", "TLB hits", "faults", "frames", "RSS (KiB)",
+	       base ? "  baseline" : "");
+	for (unsigned int i = 0; i < nr_workloads; i++) {
+		struct workload *w = workloads[i];
+		struct result median = { 0 };
+		struct baseline *b;
+		unsigned long nr_lookups;
+
+		printf("%-8s  ", w->name);
+		if (!__measure(w, &median)) {
+			printf("failed\n");
+			ok = false;
+			continue;
+		}
+
+		nr_lookups = median.nr_tlb_hits + median.nr_tlb_misses;
+		printf("%10lu  %8.3f  %12.0f  %7.2f%%  %10lu  %8u  %10ld", median.nr_accesses,
+		       median.seconds, __throughput(&median),
+		       nr_lookups ? median.nr_tlb_hits * 100.0 / nr_lookups : 0.0,
+		       median.nr_faults, median.nr_frames, median.rss);
+
+		if (base) {
+			b = __find_baseline(w->name);
+			if (!b) {
+				printf("  none");
+			} else {
+				double change = (__throughput(&median) / b->throughput - 1) * 100;
+
+				printf("  %+7.2f%%", change);
+				if (change < -tolerance) {
+					printf("  REGRESSED");
+					ok = false;
+				}
+			}
+		}
+		printf("\n");
+
+		if (saved)
+			fprintf(saved, "%s %.0f\n", w->name, __throughput(&median));
+	}
+
+	if (saved)
+		fclose(saved);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}